@@ -3,7 +3,12 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* Most requests the dispatcher merges into one device command. */
+#define MAX_MERGE 64
 
 /* List of all block devices. */
 static struct list all_blocks = LIST_INITIALIZER(all_blocks);
@@ -12,6 +17,9 @@ static struct list all_blocks = LIST_INITIALIZER(all_blocks);
 static struct block* block_by_role[BLOCK_ROLE_CNT];
 
 static struct block* list_elem_to_block(struct list_elem*);
+static void dispatcher(void* block_);
+static void enqueue(struct block*, struct block_request*);
+static void update_queue_depth(struct block*, int delta);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -75,14 +83,33 @@ static void check_sector(struct block* block, block_sector_t sector) {
   }
 }
 
+/* Completion function for block_read() and block_write(). */
+static void wake_submitter(struct block_request* r) { sema_up(r->aux); }
+
+/* Submits a request to transfer SECTOR of BLOCK to or from
+   BUFFER and waits for it to complete. */
+static void transfer_sync(struct block* block, block_sector_t sector, void* buffer, bool write) {
+  struct block_request r;
+  struct semaphore done;
+  uint64_t start = timer_tsc();
+
+  sema_init(&done, 0);
+  r.sector = sector;
+  r.buffer = buffer;
+  r.write = write;
+  r.done = wake_submitter;
+  r.aux = &done;
+  block_submit(block, &r);
+  sema_down(&done);
+  thread_current()->usage.io_wait_us += timer_tsc_to_us(timer_tsc() - start);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
    per-block device locking is unneeded. */
 void block_read(struct block* block, block_sector_t sector, void* buffer) {
-  check_sector(block, sector);
-  block->ops->read(block->aux, sector, buffer);
-  block->read_cnt++;
+  transfer_sync(block, sector, buffer, false);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -91,10 +118,173 @@ void block_read(struct block* block, block_sector_t sector, void* buffer) {
    Internally synchronizes accesses to block devices, so external
    per-block device locking is unneeded. */
 void block_write(struct block* block, block_sector_t sector, const void* buffer) {
-  check_sector(block, sector);
-  ASSERT(block->type != BLOCK_FOREIGN);
-  block->ops->write(block->aux, sector, buffer);
-  block->write_cnt++;
+  transfer_sync(block, sector, (void*)buffer, true);
+}
+
+/* Adds DELTA to BLOCK's count of outstanding requests and keeps
+   track of its maximum. */
+static void update_queue_depth(struct block* block, int delta) {
+  block->queue_depth += delta;
+  if (block->queue_depth > block->max_queue_depth)
+    block->max_queue_depth = block->queue_depth;
+}
+
+/* Records that request R took US microseconds on BLOCK. */
+static void record_latency(struct block* block, const struct block_request* r, uint64_t us) {
+  int bucket = 0;
+
+  while (us > 1 && bucket < IOSTAT_BUCKETS - 1) {
+    us >>= 1;
+    bucket++;
+  }
+  if (r->write)
+    block->write_latency[bucket]++;
+  else
+    block->read_latency[bucket]++;
+}
+
+/* Orders block requests by sector. */
+static bool request_less(const struct list_elem* a_, const struct list_elem* b_,
+                         void* aux UNUSED) {
+  const struct block_request* a = list_entry(a_, struct block_request, elem);
+  const struct block_request* b = list_entry(b_, struct block_request, elem);
+  return a->sector < b->sector;
+}
+
+/* Queues request R on BLOCK and returns without waiting for it.
+   R->done is called, from BLOCK's dispatcher thread, once the
+   transfer has finished.  Requests for the same sector complete
+   in the order submitted; otherwise the dispatcher is free to
+   reorder them. */
+void block_submit(struct block* block, struct block_request* r) {
+  r->origin = block;
+  r->start_tsc = timer_tsc();
+  enqueue(block, r);
+}
+
+/* Adds request R to the request queue of BLOCK, or, if BLOCK is
+   only a window onto another device, to that device's. */
+static void enqueue(struct block* block, struct block_request* r) {
+  check_sector(block, r->sector);
+  if (r->write) {
+    ASSERT(block->type != BLOCK_FOREIGN);
+    block->write_cnt++;
+  } else
+    block->read_cnt++;
+
+  if (block->ops->translate != NULL) {
+    enqueue(block->ops->translate(block->aux, &r->sector), r);
+    return;
+  }
+
+  lock_acquire(&block->queue_lock);
+  update_queue_depth(block, 1);
+  if (r->origin != block)
+    update_queue_depth(r->origin, 1);
+  list_insert_ordered(&block->queue, &r->elem, request_less, NULL);
+  cond_signal(&block->queue_nonempty, &block->queue_lock);
+  lock_release(&block->queue_lock);
+}
+
+/* Removes and returns the request that BLOCK should service
+   next, following a C-SCAN sweep: the lowest-numbered request at
+   or after the head, or, if there is none, the lowest-numbered
+   request overall.  Requests that immediately follow it on disk
+   and go in the same direction are moved into BATCH, for a total
+   of at most MAX_MERGE.  BLOCK's queue must be nonempty and its
+   queue lock held. */
+static void next_batch(struct block* block, struct list* batch) {
+  struct block_request* first = NULL;
+  struct list_elem* e;
+
+  ASSERT(!list_empty(&block->queue));
+  for (e = list_begin(&block->queue); e != list_end(&block->queue); e = list_next(e)) {
+    struct block_request* r = list_entry(e, struct block_request, elem);
+    if (r->sector >= block->head) {
+      first = r;
+      break;
+    }
+  }
+  if (first == NULL)
+    first = list_entry(list_begin(&block->queue), struct block_request, elem);
+
+  e = &first->elem;
+  while (e != list_end(&block->queue) && list_size(batch) < MAX_MERGE) {
+    struct block_request* r = list_entry(e, struct block_request, elem);
+    struct list_elem* next = list_next(e);
+
+    if (r != first && (r->write != first->write || r->sector != block->head))
+      break;
+    list_remove(e);
+    list_push_back(batch, e);
+    block->head = r->sector + 1;
+    e = next;
+  }
+}
+
+/* Performs the transfers in BATCH, a list of requests for
+   consecutive sectors all in the same direction, on BLOCK. */
+static void dispatch_batch(struct block* block, struct list* batch) {
+  struct block_request* first = list_entry(list_front(batch), struct block_request, elem);
+  void* buffers[MAX_MERGE];
+  size_t cnt = 0;
+  struct list_elem* e;
+
+  for (e = list_begin(batch); e != list_end(batch); e = list_next(e))
+    buffers[cnt++] = list_entry(e, struct block_request, elem)->buffer;
+
+  if (first->write && block->ops->write_multiple != NULL)
+    block->ops->write_multiple(block->aux, first->sector, buffers, cnt);
+  else if (!first->write && block->ops->read_multiple != NULL)
+    block->ops->read_multiple(block->aux, first->sector, buffers, cnt);
+  else {
+    size_t i;
+    for (i = 0; i < cnt; i++)
+      if (first->write)
+        block->ops->write(block->aux, first->sector + i, buffers[i]);
+      else
+        block->ops->read(block->aux, first->sector + i, buffers[i]);
+  }
+}
+
+/* Dispatcher thread for a block device.  Services the device's
+   request queue one merged batch at a time. */
+static void dispatcher(void* block_) {
+  struct block* block = block_;
+
+  for (;;) {
+    struct list batch;
+    struct list_elem* e;
+    uint64_t now;
+
+    list_init(&batch);
+    lock_acquire(&block->queue_lock);
+    while (list_empty(&block->queue))
+      cond_wait(&block->queue_nonempty, &block->queue_lock);
+    next_batch(block, &batch);
+    lock_release(&block->queue_lock);
+
+    dispatch_batch(block, &batch);
+    now = timer_tsc();
+    lock_acquire(&block->queue_lock);
+    for (e = list_begin(&batch); e != list_end(&batch); e = list_next(e)) {
+      struct block_request* r = list_entry(e, struct block_request, elem);
+      uint64_t us = timer_tsc_to_us(now - r->start_tsc);
+
+      record_latency(block, r, us);
+      update_queue_depth(block, -1);
+      if (r->origin != block) {
+        record_latency(r->origin, r, us);
+        update_queue_depth(r->origin, -1);
+      }
+    }
+    lock_release(&block->queue_lock);
+
+    while (!list_empty(&batch)) {
+      struct block_request* r = list_entry(list_pop_front(&batch), struct block_request, elem);
+      r->done(r);
+    }
+  }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -106,8 +296,37 @@ const char* block_name(struct block* block) { return block->name; }
 /* Returns BLOCK's type. */
 enum block_type block_type(struct block* block) { return block->type; }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Copies BLOCK's statistics into *STATS. */
+void block_get_stats(struct block* block, struct iostat* stats) {
+  int i;
+
+  stats->bytes_read = block->read_cnt * BLOCK_SECTOR_SIZE;
+  stats->bytes_written = block->write_cnt * BLOCK_SECTOR_SIZE;
+  for (i = 0; i < IOSTAT_BUCKETS; i++) {
+    stats->read_latency[i] = block->read_latency[i];
+    stats->write_latency[i] = block->write_latency[i];
+  }
+  stats->queue_depth = block->queue_depth;
+  stats->max_queue_depth = block->max_queue_depth;
+}
+
+/* Prints the nonempty buckets of latency histogram HIST for
+   BLOCK, labeled with the direction WHAT. */
+static void print_histogram(struct block* block, const char* what, const uint32_t hist[]) {
+  int i;
+
+  printf("%s: %s latency (us):", block->name, what);
+  for (i = 0; i < IOSTAT_BUCKETS; i++)
+    if (hist[i] != 0)
+      printf(" [%u,%u):%" PRIu32, i == 0 ? 0 : 1u << i, 1u << (i + 1), hist[i]);
+  printf("\n");
+}
+
+/* Prints statistics for each block device used for a Pintos
+   role, then latency and queue statistics for every block device
+   that has been used. */
 void block_print_stats(void) {
+  struct list_elem* e;
   int i;
 
   for (i = 0; i < BLOCK_ROLE_CNT; i++) {
@@ -117,6 +336,19 @@ void block_print_stats(void) {
              block->read_cnt, block->write_cnt);
     }
   }
+
+  for (e = list_begin(&all_blocks); e != list_end(&all_blocks); e = list_next(e)) {
+    struct block* block = list_entry(e, struct block, list_elem);
+    if (block->read_cnt == 0 && block->write_cnt == 0)
+      continue;
+    printf("%s: %llu bytes read, %llu bytes written, max queue depth %u\n", block->name,
+           block->read_cnt * BLOCK_SECTOR_SIZE, block->write_cnt * BLOCK_SECTOR_SIZE,
+           block->max_queue_depth);
+    if (block->read_cnt != 0)
+      print_histogram(block, "read", block->read_latency);
+    if (block->write_cnt != 0)
+      print_histogram(block, "write", block->write_latency);
+  }
 }
 
 /* Registers a new block device with the given NAME.  If
@@ -138,6 +370,14 @@ struct block* block_register(const char* name, enum block_type type, const char*
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  memset(block->read_latency, 0, sizeof block->read_latency);
+  memset(block->write_latency, 0, sizeof block->write_latency);
+  block->queue_depth = 0;
+  block->max_queue_depth = 0;
+  lock_init(&block->queue_lock);
+  cond_init(&block->queue_nonempty);
+  list_init(&block->queue);
+  block->head = 0;
 
   printf("%s: %'" PRDSNu " sectors (", block->name, block->size);
   print_human_readable_size((uint64_t)block->size * BLOCK_SECTOR_SIZE);
@@ -146,6 +386,13 @@ struct block* block_register(const char* name, enum block_type type, const char*
     printf(", %s", extra_info);
   printf("\n");
 
+  if (ops->translate == NULL) {
+    char thread_name[16];
+    snprintf(thread_name, sizeof thread_name, "blk-%.11s", block->name);
+    if (thread_create(thread_name, PRI_MAX, dispatcher, block) == TID_ERROR)
+      PANIC("Failed to start dispatcher for block device %s", block->name);
+  }
+
   return block;
 }
 
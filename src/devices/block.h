@@ -3,7 +3,9 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <iostat.h>
 #include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -22,6 +24,29 @@ typedef uint32_t block_sector_t;
 /* Higher-level interface for file systems, etc. */
 
 struct block;
+struct block_request;
+
+/* Called by a device's dispatcher when REQUEST has completed. */
+typedef void block_done_func(struct block_request* request);
+
+/* An asynchronous request to transfer one sector.
+   The submitter fills in every member except `elem', passes the
+   request to block_submit(), and must keep the request and its
+   buffer alive until DONE is called.  DONE runs in the device's
+   dispatcher thread, not in the submitting thread, so it should
+   do little more than wake someone up. */
+struct block_request {
+  struct list_elem elem; /* Element in the device's request queue. */
+  block_sector_t sector; /* Sector to transfer. */
+  void* buffer;          /* BLOCK_SECTOR_SIZE bytes of data. */
+  bool write;            /* True to write BUFFER, false to read. */
+  block_done_func* done; /* Completion function. */
+  void* aux;             /* Extra data for DONE. */
+
+  /* Set by block_submit(). */
+  struct block* origin; /* Device the request was submitted to. */
+  uint64_t start_tsc;   /* Time-stamp counter at submission. */
+};
 
 /* Type of a block device. */
 enum block_type {
@@ -52,6 +77,17 @@ struct block {
 
   unsigned long long read_cnt;  /* Number of sectors read. */
   unsigned long long write_cnt; /* Number of sectors written. */
+  uint32_t read_latency[IOSTAT_BUCKETS];  /* Read latency histogram. */
+  uint32_t write_latency[IOSTAT_BUCKETS]; /* Write latency histogram. */
+  unsigned queue_depth;                   /* Requests queued or in flight. */
+  unsigned max_queue_depth;               /* Maximum queue_depth so far. */
+
+  /* Request queue, unused for devices whose driver translates
+     requests onto another device. */
+  struct lock queue_lock;          /* Protects the members below. */
+  struct condition queue_nonempty; /* Signaled when a request arrives. */
+  struct list queue;               /* Pending requests, sorted by sector. */
+  block_sector_t head;             /* Sector following the last dispatched one. */
 };
 
 const char* block_type_name(enum block_type);
@@ -68,10 +104,12 @@ struct block* block_next(struct block*);
 block_sector_t block_size(struct block*);
 void block_read(struct block*, block_sector_t, void*);
 void block_write(struct block*, block_sector_t, const void*);
+void block_submit(struct block*, struct block_request*);
 const char* block_name(struct block*);
 enum block_type block_type(struct block*);
 
 /* Statistics. */
+void block_get_stats(struct block*, struct iostat*);
 void block_print_stats(void);
 
 /* Lower-level interface to block device drivers. */
@@ -79,6 +117,18 @@ void block_print_stats(void);
 struct block_operations {
   void (*read)(void* aux, block_sector_t, void* buffer);
   void (*write)(void* aux, block_sector_t, const void* buffer);
+
+  /* Optional.  Transfer CNT consecutive sectors starting at the
+     given sector, to or from the CNT buffers in BUFFERS, as a
+     single device command.  Used for merged requests. */
+  void (*read_multiple)(void* aux, block_sector_t, void** buffers, size_t cnt);
+  void (*write_multiple)(void* aux, block_sector_t, void** buffers, size_t cnt);
+
+  /* Optional.  For drivers that are only a window onto another
+     block device, such as partitions: converts *SECTOR into a
+     sector on the underlying device and returns that device.
+     Requests are then queued on the underlying device. */
+  struct block* (*translate)(void* aux, block_sector_t* sector);
 };
 
 struct block* block_register(const char* name, enum block_type, const char* extra_info,
@@ -8,10 +8,17 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Sectors are moved with bus-master DMA when the controller is a
+   PCI IDE controller that supports it (such as the PIIX3 that
+   QEMU emulates) and the disk reports DMA support; otherwise, and
+   whenever a DMA transfer fails, with programmed I/O. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)   /* Data. */
@@ -33,7 +40,9 @@
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80  /* Busy. */
 #define STA_DRDY 0x40 /* Device Ready. */
+#define STA_DF 0x20   /* Device Fault. */
 #define STA_DRQ 0x08  /* Data Request. */
+#define STA_ERR 0x01  /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04 /* Software Reset. */
@@ -49,6 +58,37 @@
 #define CMD_IDENTIFY_DEVICE 0xec    /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20  /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30 /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8           /* READ DMA. */
+#define CMD_WRITE_DMA 0xca          /* WRITE DMA. */
+
+/* Bus master IDE register addresses, relative to a channel's
+   bus master base.  See [PIIX3] 2.7. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table address. */
+
+/* Bus master command register bits. */
+#define BM_CMD_START 0x01 /* Start bus master operation. */
+#define BM_CMD_READ 0x08  /* Transfer from disk to memory. */
+
+/* Bus master status register bits. */
+#define BM_STA_ACTIVE 0x01 /* Bus master operation in progress. */
+#define BM_STA_ERROR 0x02  /* DMA error (write 1 to clear). */
+#define BM_STA_INTR 0x04   /* Interrupt raised (write 1 to clear). */
+
+/* PCI configuration space access mechanism #1. */
+#define PCI_CONFIG_ADDRESS 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* A physical region descriptor: one scatter-gather entry of a
+   bus master transfer.  A region may not cross a 64 kB boundary. */
+struct prd {
+  uint32_t addr;  /* Physical address. */
+  uint16_t size;  /* Size in bytes, 0 meaning 64 kB. */
+  uint16_t flags; /* PRD_EOT on the last entry. */
+};
+#define PRD_EOT 0x8000     /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof(struct prd))
 
 /* An ATA device. */
 struct ata_disk {
@@ -56,6 +96,7 @@ struct ata_disk {
   struct channel* channel; /* Channel that disk is attached to. */
   int dev_no;              /* Device 0 or 1 for master or slave. */
   bool is_ata;             /* Is device an ATA disk? */
+  bool dma;                /* Use bus master DMA for this disk? */
 };
 
 /* An ATA channel (aka controller).
@@ -70,6 +111,9 @@ struct channel {
                                    any interrupt would be spurious. */
   struct semaphore completion_wait; /* Up'd by interrupt handler. */
 
+  uint16_t bm_base; /* Bus master registers, 0 if DMA unavailable. */
+  struct prd* prdt; /* Physical region descriptor table. */
+
   struct ata_disk devices[2]; /* The devices on this channel. */
 };
 
@@ -82,11 +126,14 @@ static struct block_operations ide_operations;
 static void reset_channel(struct channel*);
 static bool check_device_type(struct ata_disk*);
 static void identify_ata_device(struct ata_disk*);
+static uint16_t find_bus_master(void);
 
-static void select_sector(struct ata_disk*, block_sector_t);
+static void select_sector(struct ata_disk*, block_sector_t, size_t cnt);
 static void issue_pio_command(struct channel*, uint8_t command);
 static void input_sector(struct channel*, void*);
 static void output_sector(struct channel*, const void*);
+static bool dma_transfer(struct ata_disk*, block_sector_t, void** buffers, size_t cnt,
+                         bool write);
 
 static void wait_until_idle(const struct ata_disk*);
 static bool wait_while_busy(const struct ata_disk*);
@@ -97,6 +144,7 @@ static void interrupt_handler(struct intr_frame*);
 
 /* Initialize the disk subsystem and detect disks. */
 void ide_init(void) {
+  uint16_t bm_base = find_bus_master();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
@@ -120,6 +168,13 @@ void ide_init(void) {
     lock_init(&c->lock);
     c->expecting_interrupt = false;
     sema_init(&c->completion_wait, 0);
+    c->bm_base = 0;
+    c->prdt = NULL;
+    if (bm_base != 0) {
+      c->prdt = palloc_get_page(0);
+      if (c->prdt != NULL)
+        c->bm_base = bm_base + chan_no * 8;
+    }
 
     /* Initialize devices. */
     for (dev_no = 0; dev_no < 2; dev_no++) {
@@ -128,6 +183,7 @@ void ide_init(void) {
       d->channel = c;
       d->dev_no = dev_no;
       d->is_ata = false;
+      d->dma = false;
     }
 
     /* Register interrupt handler. */
@@ -149,6 +205,53 @@ void ide_init(void) {
 
 /* Disk detection and identification. */
 
+/* Reads the 32-bit register at offset REG in the PCI
+   configuration space of function FUNC of device DEV on bus 0. */
+static uint32_t pci_read_config(int dev, int func, int reg) {
+  outl(PCI_CONFIG_ADDRESS, 0x80000000 | (dev << 11) | (func << 8) | (reg & 0xfc));
+  return inl(PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 16-bit register at offset REG in the PCI
+   configuration space of function FUNC of device DEV on bus 0. */
+static void pci_write_config16(int dev, int func, int reg, uint16_t value) {
+  outl(PCI_CONFIG_ADDRESS, 0x80000000 | (dev << 11) | (func << 8) | (reg & 0xfc));
+  outw(PCI_CONFIG_DATA + (reg & 2), value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller capable of bus
+   mastering, enables bus mastering on it, and returns the I/O
+   port base of its bus master registers.  Returns 0 if there is
+   no such controller. */
+static uint16_t find_bus_master(void) {
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++) {
+      uint32_t id = pci_read_config(dev, func, 0x00);
+      uint32_t class = pci_read_config(dev, func, 0x08);
+      uint32_t bar4;
+
+      if ((id & 0xffff) == 0xffff)
+        continue;
+
+      /* Class 01h, subclass 01h: IDE controller.  Bit 7 of the
+         programming interface: bus master capable. */
+      if ((class >> 16) != 0x0101 || !(class & 0x8000))
+        continue;
+
+      /* BAR4 holds the bus master base, which must be in I/O
+         space. */
+      bar4 = pci_read_config(dev, func, 0x20);
+      if (!(bar4 & 1) || (bar4 & ~3u) == 0)
+        continue;
+
+      pci_write_config16(dev, func, 0x04, pci_read_config(dev, func, 0x04) | 0x05);
+      return bar4 & 0xfffc;
+    }
+  return 0;
+}
+
 static char* descramble_ata_string(char*, int size);
 
 /* Resets an ATA channel and waits for any devices present on it
@@ -260,9 +363,11 @@ static void identify_ata_device(struct ata_disk* d) {
   /* Calculate capacity.
      Read model name and serial number. */
   capacity = *(uint32_t*)&id[60 * 2];
+  d->dma = c->bm_base != 0 && (id[49 * 2 + 1] & 0x01) != 0;
   model = descramble_ata_string(&id[10 * 2], 20);
   serial = descramble_ata_string(&id[27 * 2], 40);
-  snprintf(extra_info, sizeof extra_info, "model \"%s\", serial \"%s\"", model, serial);
+  snprintf(extra_info, sizeof extra_info, "model \"%s\", serial \"%s\"%s", model, serial,
+           d->dma ? ", DMA" : "");
 
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
@@ -306,53 +411,92 @@ static char* descramble_ata_string(char* string, int size) {
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Reads CNT consecutive sectors starting at SEC_NO from disk D
+   into the CNT buffers in BUFFERS, each of which must have room
+   for BLOCK_SECTOR_SIZE bytes, using a single READ DMA command or,
+   failing that, a single READ SECTOR command.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
-static void ide_read(void* d_, block_sector_t sec_no, void* buffer) {
+static void ide_read_multiple(void* d_, block_sector_t sec_no, void** buffers, size_t cnt) {
   struct ata_disk* d = d_;
   struct channel* c = d->channel;
+  size_t i;
+
   lock_acquire(&c->lock);
-  select_sector(d, sec_no);
+  if (d->dma && dma_transfer(d, sec_no, buffers, cnt, false)) {
+    lock_release(&c->lock);
+    return;
+  }
+  select_sector(d, sec_no, cnt);
   issue_pio_command(c, CMD_READ_SECTOR_RETRY);
-  sema_down(&c->completion_wait);
-  if (!wait_while_busy(d))
-    PANIC("%s: disk read failed, sector=%" PRDSNu, d->name, sec_no);
-  input_sector(c, buffer);
+  for (i = 0; i < cnt; i++) {
+    sema_down(&c->completion_wait);
+    if (!wait_while_busy(d))
+      PANIC("%s: disk read failed, sector=%" PRDSNu, d->name, sec_no + i);
+    input_sector(c, buffers[i]);
+  }
   lock_release(&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes CNT consecutive sectors starting at SEC_NO to disk D
+   from the CNT buffers in BUFFERS, each of which must contain
+   BLOCK_SECTOR_SIZE bytes, using a single WRITE DMA or WRITE
+   SECTOR command.
+   Returns after the disk has acknowledged receiving the data.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
-static void ide_write(void* d_, block_sector_t sec_no, const void* buffer) {
+static void ide_write_multiple(void* d_, block_sector_t sec_no, void** buffers, size_t cnt) {
   struct ata_disk* d = d_;
   struct channel* c = d->channel;
+  size_t i;
+
   lock_acquire(&c->lock);
-  select_sector(d, sec_no);
+  if (d->dma && dma_transfer(d, sec_no, buffers, cnt, true)) {
+    lock_release(&c->lock);
+    return;
+  }
+  select_sector(d, sec_no, cnt);
   issue_pio_command(c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy(d))
-    PANIC("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no);
-  output_sector(c, buffer);
-  sema_down(&c->completion_wait);
+  for (i = 0; i < cnt; i++) {
+    if (!wait_while_busy(d))
+      PANIC("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no + i);
+    output_sector(c, buffers[i]);
+    sema_down(&c->completion_wait);
+  }
   lock_release(&c->lock);
 }
 
-static struct block_operations ide_operations = {ide_read, ide_write};
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes. */
+static void ide_read(void* d, block_sector_t sec_no, void* buffer) {
+  ide_read_multiple(d, sec_no, &buffer, 1);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes. */
+static void ide_write(void* d, block_sector_t sec_no, const void* buffer) {
+  void* buffers[1] = {(void*)buffer};
+  ide_write_multiple(d, sec_no, buffers, 1);
+}
+
+static struct block_operations ide_operations = {
+    .read = ide_read,
+    .write = ide_write,
+    .read_multiple = ide_read_multiple,
+    .write_multiple = ide_write_multiple,
+};
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
-static void select_sector(struct ata_disk* d, block_sector_t sec_no) {
+   writes SEC_NO and CNT to the disk's sector selection and
+   sector count registers.  (We use LBA mode.) */
+static void select_sector(struct ata_disk* d, block_sector_t sec_no, size_t cnt) {
   struct channel* c = d->channel;
 
   ASSERT(sec_no < (1UL << 28));
+  ASSERT(cnt > 0 && cnt <= 256);
 
   select_device_wait(d);
-  outb(reg_nsect(c), 1);
+  outb(reg_nsect(c), cnt == 256 ? 0 : cnt);
   outb(reg_lbal(c), sec_no);
   outb(reg_lbam(c), sec_no >> 8);
   outb(reg_lbah(c), (sec_no >> 16));
@@ -370,6 +514,78 @@ static void issue_pio_command(struct channel* c, uint8_t command) {
   outb(reg_command(c), command);
 }
 
+/* Fills in D's channel's PRD table to describe the CNT sector
+   buffers in BUFFERS.  Each buffer is physically contiguous, as
+   all kernel virtual memory is, but may straddle a 64 kB
+   boundary, in which case it takes two entries.  Returns false
+   if a buffer is not in kernel memory. */
+static bool build_prdt(struct channel* c, void** buffers, size_t cnt) {
+  struct prd* prd = c->prdt;
+  size_t i;
+
+  for (i = 0; i < cnt; i++) {
+    uint32_t addr, end;
+
+    if (!is_kernel_vaddr(buffers[i]))
+      return false;
+    addr = vtop(buffers[i]);
+    end = addr + BLOCK_SECTOR_SIZE;
+    while (addr < end) {
+      uint32_t boundary = (addr | 0xffff) + 1;
+      uint32_t chunk_end = end < boundary ? end : boundary;
+
+      ASSERT(prd < c->prdt + PRD_CNT);
+      prd->addr = addr;
+      prd->size = chunk_end - addr;
+      prd->flags = 0;
+      prd++;
+      addr = chunk_end;
+    }
+  }
+  prd[-1].flags = PRD_EOT;
+  return true;
+}
+
+/* Transfers CNT consecutive sectors starting at SEC_NO between
+   disk D and the buffers in BUFFERS using bus master DMA.
+   Returns true if successful.  On failure, disables DMA for D
+   and returns false, so that the caller can retry with PIO.
+   D's channel must be locked. */
+static bool dma_transfer(struct ata_disk* d, block_sector_t sec_no, void** buffers, size_t cnt,
+                         bool write) {
+  struct channel* c = d->channel;
+  uint8_t status;
+
+  ASSERT(lock_held_by_current_thread(&c->lock));
+  if (!build_prdt(c, buffers, cnt))
+    return false;
+
+  /* Program the bus master: table, direction, clear status. */
+  outl(reg_bm_prdt(c), vtop(c->prdt));
+  outb(reg_bm_command(c), write ? 0 : BM_CMD_READ);
+  outb(reg_bm_status(c), BM_STA_ERROR | BM_STA_INTR);
+
+  /* Start the disk, then the bus master, and wait for the
+     completion interrupt. */
+  select_sector(d, sec_no, cnt);
+  issue_pio_command(c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb(reg_bm_command(c), (write ? 0 : BM_CMD_READ) | BM_CMD_START);
+  sema_down(&c->completion_wait);
+
+  /* Stop the bus master and check the outcome. */
+  status = inb(reg_bm_status(c));
+  outb(reg_bm_command(c), write ? 0 : BM_CMD_READ);
+  outb(reg_bm_status(c), BM_STA_ERROR | BM_STA_INTR);
+  if ((status & (BM_STA_ERROR | BM_STA_ACTIVE)) ||
+      (inb(reg_alt_status(c)) & (STA_BSY | STA_DF | STA_ERR))) {
+    printf("%s: DMA %s failed, sector=%" PRDSNu ", falling back to PIO\n", d->name,
+           write ? "write" : "read", sec_no);
+    d->dma = false;
+    return false;
+  }
+  return true;
+}
+
 /* Reads a sector from channel C's data register in PIO mode into
    SECTOR, which must have room for BLOCK_SECTOR_SIZE bytes. */
 static void input_sector(struct channel* c, void* sector) {
@@ -286,4 +286,14 @@ static void partition_write(void* p_, block_sector_t sector, const void* buffer)
   block_write(p->block, p->start + sector, buffer);
 }
 
-static struct block_operations partition_operations = {partition_read, partition_write};
+/* Converts SECTOR within partition P into a sector on P's
+   underlying device, so that requests to P are queued and
+   scheduled together with every other request to that device. */
+static struct block* partition_translate(void* p_, block_sector_t* sector) {
+  struct partition* p = p_;
+  *sector += p->start;
+  return p->block;
+}
+
+static struct block_operations partition_operations = {
+    .read = partition_read, .write = partition_write, .translate = partition_translate};
@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL 0x43                        /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL)) /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -75,3 +72,38 @@ void pit_configure_channel(int channel, int mode, int frequency) {
   outb(PIT_PORT_COUNTER(channel), count >> 8);
   intr_set_level(old_level);
 }
+
+/* Starts channel 0 of the PIT counting down COUNT cycles in mode
+   0, "interrupt on terminal count", so that it raises its output,
+   and thus interrupt line 0, once COUNT cycles from now and does
+   not repeat.  After reaching 0, the counter keeps counting down
+   from PIT_COUNT_MAX.  Use pit_configure_channel() to go back to
+   periodic interrupts. */
+void pit_oneshot(int channel, unsigned count) {
+  enum intr_level old_level;
+
+  ASSERT(channel == 0);
+  ASSERT(count > 0 && count <= PIT_COUNT_MAX);
+
+  old_level = intr_disable();
+  outb(PIT_PORT_CONTROL, (channel << 6) | 0x30);
+  outb(PIT_PORT_COUNTER(channel), count);
+  outb(PIT_PORT_COUNTER(channel), count >> 8);
+  intr_set_level(old_level);
+}
+
+/* Returns the current value of CHANNEL's counter, latched so
+   that its two bytes are read consistently. */
+unsigned pit_read_counter(int channel) {
+  enum intr_level old_level;
+  unsigned count;
+
+  ASSERT(channel == 0 || channel == 2);
+
+  old_level = intr_disable();
+  outb(PIT_PORT_CONTROL, channel << 6);
+  count = inb(PIT_PORT_COUNTER(channel));
+  count |= inb(PIT_PORT_COUNTER(channel)) << 8;
+  intr_set_level(old_level);
+  return count;
+}
@@ -3,6 +3,14 @@
 
 #include <stdint.h>
 
+/* PIT cycles per second. */
+#define PIT_HZ 1193180
+
+/* Largest count a PIT channel can be loaded with. */
+#define PIT_COUNT_MAX 65535
+
 void pit_configure_channel(int channel, int mode, int frequency);
+void pit_oneshot(int channel, unsigned count);
+unsigned pit_read_counter(int channel);
 
 #endif /* devices/pit.h */
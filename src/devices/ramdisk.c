@@ -0,0 +1,74 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A block device backed by kernel memory.  Its contents do not
+   survive a reboot, but it costs no emulated disk I/O, which
+   makes it useful for measuring the file system by itself.  The
+   device is registered as a raw device named "ram0"; select it
+   for a role with, e.g., "-filesys=ram0 -f" or "-swap=ram0". */
+
+/* Sectors that fit in one page. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A RAM disk.  The data is kept in individually allocated pages
+   so that a large disk does not need contiguous memory. */
+struct ramdisk {
+  size_t page_cnt; /* Number of pages. */
+  uint8_t** pages; /* Data pages. */
+};
+
+static struct block_operations ramdisk_operations;
+
+/* Creates and registers a zero-filled RAM disk of SIZE_KB
+   kilobytes, rounded up to a whole number of pages.  Panics if
+   there is not enough kernel memory. */
+void ramdisk_init(size_t size_kb) {
+  struct ramdisk* rd;
+  size_t i;
+
+  rd = malloc(sizeof *rd);
+  if (rd == NULL)
+    PANIC("Failed to allocate memory for RAM disk descriptor");
+  rd->page_cnt = DIV_ROUND_UP(size_kb * 1024, PGSIZE);
+  rd->pages = calloc(rd->page_cnt, sizeof *rd->pages);
+  if (rd->pages == NULL)
+    PANIC("Failed to allocate memory for RAM disk page table");
+  for (i = 0; i < rd->page_cnt; i++) {
+    rd->pages[i] = palloc_get_page(PAL_ZERO);
+    if (rd->pages[i] == NULL)
+      PANIC("Out of memory allocating %zu kB RAM disk", size_kb);
+  }
+
+  block_register("ram0", BLOCK_RAW, "RAM disk", rd->page_cnt * SECTORS_PER_PAGE,
+                 &ramdisk_operations, rd);
+}
+
+/* Returns the address of sector SECTOR within RAM disk RD. */
+static uint8_t* sector_addr(struct ramdisk* rd, block_sector_t sector) {
+  ASSERT(sector / SECTORS_PER_PAGE < rd->page_cnt);
+  return rd->pages[sector / SECTORS_PER_PAGE] + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE;
+}
+
+/* Reads sector SECTOR from RAM disk RD into BUFFER, which must
+   have room for BLOCK_SECTOR_SIZE bytes. */
+static void ramdisk_read(void* rd, block_sector_t sector, void* buffer) {
+  memcpy(buffer, sector_addr(rd, sector), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes sector SECTOR to RAM disk RD from BUFFER, which must
+   contain BLOCK_SECTOR_SIZE bytes. */
+static void ramdisk_write(void* rd, block_sector_t sector, const void* buffer) {
+  memcpy(sector_addr(rd, sector), buffer, BLOCK_SECTOR_SIZE);
+}
+
+static struct block_operations ramdisk_operations = {
+    .read = ramdisk_read,
+    .write = ramdisk_write,
+};
@@ -18,17 +18,48 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
+/* PIT cycles per timer tick. */
+#define TICK_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* If false (default), the timer interrupts every tick.
+   If true, set by the kernel command-line option "-tickless",
+   ticks are skipped while the CPU is idle. */
+bool timer_tickless;
+
+/* While the PIT is in one-shot mode, the state of the countdown.
+   Each tick boundary the countdown passes is a tick that has not
+   yet been counted in TICKS.  Accessed only with interrupts
+   off. */
+static struct {
+  bool active;        /* In one-shot mode? */
+  unsigned count;     /* PIT cycles loaded into the counter. */
+  unsigned first;     /* PIT cycles to the first tick boundary. */
+  int64_t boundaries; /* Tick boundaries by the end of the count. */
+} oneshot;
+
+/* Number of timer interrupts that tickless idle avoided. */
+static int64_t skipped_ticks;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
-static struct list sleeping_list;
+/* Number of time-stamp counter cycles per microsecond.
+   Initialized by timer_calibrate(). */
+static uint64_t tsc_per_us;
+
+/* Pending timeouts, keyed by the tick at which they fire.
+   Accessed only with interrupts off. */
+static struct wheel timeouts;
 
 static intr_handler_func timer_interrupt;
+static void run_timeouts(void);
+static void catch_up(int64_t);
 static bool too_many_loops(unsigned loops);
+static void calibrate_tsc(void);
 static void busy_wait(int64_t loops);
 static void real_time_sleep(int64_t num, int32_t denom);
 static void real_time_delay(int64_t num, int32_t denom);
@@ -38,7 +69,7 @@ static void real_time_delay(int64_t num, int32_t denom);
 void timer_init(void) {
   pit_configure_channel(0, 2, TIMER_FREQ);
   intr_register_ext(0x20, timer_interrupt, "8254 Timer");
-  list_init(&sleeping_list);
+  wheel_init(&timeouts, ticks);
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -63,6 +94,24 @@ void timer_calibrate(void) {
       loops_per_tick |= test_bit;
 
   printf("%'" PRIu64 " loops/s.\n", (uint64_t)loops_per_tick * TIMER_FREQ);
+  calibrate_tsc();
+}
+
+/* Calibrates tsc_per_us by counting time-stamp counter cycles
+   across one timer tick. */
+static void calibrate_tsc(void) {
+  int64_t start = ticks;
+  uint64_t tsc_start;
+
+  while (ticks == start)
+    barrier();
+  start = ticks;
+  tsc_start = timer_tsc();
+  while (ticks == start)
+    barrier();
+  tsc_per_us = (timer_tsc() - tsc_start) * TIMER_FREQ / 1000000;
+  if (tsc_per_us == 0)
+    tsc_per_us = 1;
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -77,23 +126,59 @@ int64_t timer_ticks(void) {
    should be a value once returned by timer_ticks(). */
 int64_t timer_elapsed(int64_t then) { return timer_ticks() - then; }
 
-/* Helper less function. */
-static bool less(const struct list_elem* a, const struct list_elem* b, void* aux) {
-  struct thread* t1 = list_entry(a, struct thread, sleepelem);
-  struct thread* t2 = list_entry(b, struct thread, sleepelem);
-  return (t1->wakeup_tick) < (t2->wakeup_tick) ? true : false;
+/* Arranges for FUNC to be called with AUX from the timer
+   interrupt handler once timer_ticks() reaches EXPIRES, or on the
+   next tick if it already has.  T must not already be pending.
+   May be called from an interrupt handler. */
+void timeout_add(struct timeout* t, int64_t expires, timeout_func* func, void* aux) {
+  enum intr_level old_level;
+
+  ASSERT(t != NULL);
+  ASSERT(func != NULL);
+
+  old_level = intr_disable();
+  t->pending = true;
+  t->func = func;
+  t->aux = aux;
+  wheel_insert(&timeouts, &t->elem, expires);
+  intr_set_level(old_level);
+}
+
+/* Cancels timeout T.  Returns true if T was pending, false if it
+   had already fired or been cancelled. */
+bool timeout_cancel(struct timeout* t) {
+  enum intr_level old_level;
+  bool pending;
+
+  ASSERT(t != NULL);
+
+  old_level = intr_disable();
+  pending = t->pending;
+  if (pending) {
+    wheel_remove(&t->elem);
+    t->pending = false;
+  }
+  intr_set_level(old_level);
+  return pending;
 }
 
+/* Timeout function that wakes up the sleeping thread AUX. */
+static void wake_sleeper(void* aux) { thread_unblock(aux); }
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void timer_sleep(int64_t ticks) {
+  struct timeout t;
+  enum intr_level old_level;
+
   ASSERT(intr_get_level() == INTR_ON);
-  struct thread* t = thread_current();
-  t->wakeup_tick = timer_ticks() + ticks;
-  list_insert_ordered(&sleeping_list, &t->sleepelem, &less, NULL);
-  intr_disable();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable();
+  timeout_add(&t, timer_ticks() + ticks, wake_sleeper, thread_current());
   thread_block();
-  intr_enable();
+  intr_set_level(old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -135,23 +220,121 @@ void timer_udelay(int64_t us) { real_time_delay(us, 1000 * 1000); }
    instead if interrupts are enabled.*/
 void timer_ndelay(int64_t ns) { real_time_delay(ns, 1000 * 1000 * 1000); }
 
+/* Returns the CPU's time-stamp counter, which counts cycles at a
+   fixed rate much higher than TIMER_FREQ. */
+uint64_t timer_tsc(void) {
+  uint64_t tsc;
+  asm volatile("rdtsc" : "=A"(tsc));
+  return tsc;
+}
+
+/* Converts CYCLES time-stamp counter cycles into microseconds.
+   Returns 0 before timer_calibrate() has run. */
+uint64_t timer_tsc_to_us(uint64_t cycles) { return tsc_per_us != 0 ? cycles / tsc_per_us : 0; }
+
 /* Prints timer statistics. */
-void timer_print_stats(void) { printf("Timer: %" PRId64 " ticks\n", timer_ticks()); }
+void timer_print_stats(void) {
+  printf("Timer: %" PRId64 " ticks", timer_ticks());
+  if (timer_tickless)
+    printf(", %" PRId64 " skipped while idle", skipped_ticks);
+  printf("\n");
+}
+
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  In tickless mode, switches the PIT to one-shot
+   mode so that the next interrupt arrives at the tick boundary at
+   which the next timeout is due, or as late as the PIT's counter
+   allows, instead of at the next tick. */
+void timer_idle(void) {
+  unsigned first;
+  int64_t boundaries;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (!timer_tickless || oneshot.active)
+    return;
+
+  /* The periodic counter counts down the PIT cycles left until
+     the next tick. */
+  first = pit_read_counter(0);
+  if (first == 0 || first > TICK_CYCLES)
+    return;
+
+  boundaries = 1 + (PIT_COUNT_MAX - first) / TICK_CYCLES;
+  boundaries = wheel_next(&timeouts, ticks + boundaries) - ticks;
+  if (boundaries <= 1)
+    return;
+
+  oneshot.active = true;
+  oneshot.first = first;
+  oneshot.boundaries = boundaries;
+  oneshot.count = first + (boundaries - 1) * TICK_CYCLES;
+  pit_oneshot(0, oneshot.count);
+}
+
+/* Called on entry to every external interrupt handler.  If the
+   PIT is in one-shot mode, brings TICKS up to date with the tick
+   boundaries that have passed.  If the countdown has finished,
+   returns the PIT to periodic mode; its pending interrupt then
+   counts as the final tick.  Otherwise, shortens the countdown to
+   end at the next tick boundary, so that ticks resume at their
+   usual phase whether or not the CPU goes back to idle. */
+void timer_irq_enter(void) {
+  unsigned remaining, elapsed;
+  int64_t passed;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (!oneshot.active)
+    return;
+
+  remaining = pit_read_counter(0);
+  if (remaining == 0 || remaining > oneshot.count) {
+    /* Counted past 0: the countdown is over. */
+    oneshot.active = false;
+    pit_configure_channel(0, 2, TIMER_FREQ);
+    catch_up(oneshot.boundaries - 1);
+    return;
+  }
+
+  elapsed = oneshot.count - remaining;
+  passed = elapsed < oneshot.first ? 0 : 1 + (elapsed - oneshot.first) / TICK_CYCLES;
+  if (passed > 0) {
+    remaining = TICK_CYCLES - (elapsed - oneshot.first) % TICK_CYCLES;
+    catch_up(passed);
+  }
+  oneshot.first = oneshot.count = remaining;
+  oneshot.boundaries = 1;
+  pit_oneshot(0, remaining);
+}
+
+/* Counts N ticks that passed without timer interrupts. */
+static void catch_up(int64_t n) {
+  skipped_ticks += n;
+  while (n-- > 0) {
+    ticks++;
+    thread_tick(false);
+  }
+  run_timeouts();
+}
 
 /* Timer interrupt handler. */
-static void timer_interrupt(struct intr_frame* args UNUSED) {
+static void timer_interrupt(struct intr_frame* args) {
   ticks++;
-  thread_tick();
-  if (!list_empty(&sleeping_list)) {
-    struct thread* curr_t = list_entry(list_begin(&sleeping_list), struct thread, sleepelem);
-    while ((curr_t->wakeup_tick) <= timer_ticks()) {
-      list_pop_front(&sleeping_list);
-      thread_unblock(curr_t);
-      if (!list_empty(&sleeping_list)) {
-        curr_t = list_entry(list_begin(&sleeping_list), struct thread, sleepelem);
-      } else
-        break;
-    }
+  thread_tick((args->cs & 3) == 3); /* Interrupted privilege level 3? */
+  run_timeouts();
+}
+
+/* Fires every timeout that is due at the current tick. */
+static void run_timeouts(void) {
+  struct list expired;
+
+  list_init(&expired);
+  wheel_advance(&timeouts, ticks, &expired);
+  while (!list_empty(&expired)) {
+    struct timeout* t = list_entry(list_pop_front(&expired), struct timeout, elem.list_elem);
+    t->pending = false;
+    t->func(t->aux);
   }
 }
 
@@ -2,13 +2,22 @@
 #define DEVICES_TIMER_H
 
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include <wheel.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* If false (default), the timer interrupts every tick.
+   If true, set by the kernel command-line option "-tickless",
+   ticks are skipped while the CPU is idle. */
+extern bool timer_tickless;
+
 void timer_init(void);
 void timer_calibrate(void);
+void timer_idle(void);
+void timer_irq_enter(void);
 
 int64_t timer_ticks(void);
 int64_t timer_elapsed(int64_t);
@@ -19,11 +28,32 @@ void timer_msleep(int64_t milliseconds);
 void timer_usleep(int64_t microseconds);
 void timer_nsleep(int64_t nanoseconds);
 
+/* One-shot timeouts.
+
+   A timeout calls a function, in the timer interrupt handler,
+   once timer_ticks() reaches a given value.  The function must
+   not sleep.  A pending timeout may be cancelled. */
+typedef void timeout_func(void* aux);
+
+struct timeout {
+  struct wheel_elem elem; /* Element in the timer wheel. */
+  bool pending;           /* Added but not yet fired or cancelled? */
+  timeout_func* func;     /* Function to call. */
+  void* aux;              /* Auxiliary data for FUNC. */
+};
+
+void timeout_add(struct timeout*, int64_t expires, timeout_func*, void* aux);
+bool timeout_cancel(struct timeout*);
+
 /* Busy waits. */
 void timer_mdelay(int64_t milliseconds);
 void timer_udelay(int64_t microseconds);
 void timer_ndelay(int64_t nanoseconds);
 
+/* High-resolution time. */
+uint64_t timer_tsc(void);
+uint64_t timer_tsc_to_us(uint64_t cycles);
+
 void timer_print_stats(void);
 
 #endif /* devices/timer.h */
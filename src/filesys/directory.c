@@ -5,8 +5,18 @@
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 
+static void dir_ctor(void*);
+
+/* Open directories. */
+static struct slab_cache dir_cache =
+    SLAB_CACHE_INITIALIZER(dir_cache, "dir", sizeof(struct dir), dir_ctor);
+
+/* Clears newly allocated DIR. */
+static void dir_ctor(void* dir) { memset(dir, 0, sizeof(struct dir)); }
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool dir_create(block_sector_t sector, size_t entry_cnt) {
@@ -16,14 +26,14 @@ bool dir_create(block_sector_t sector, size_t entry_cnt) {
 /* Opens and returns the directory for the given INODE, of which
    it takes ownership.  Returns a null pointer on failure. */
 struct dir* dir_open(struct inode* inode) {
-  struct dir* dir = calloc(1, sizeof *dir);
+  struct dir* dir = slab_alloc(&dir_cache);
   if (inode != NULL && dir != NULL) {
     dir->inode = inode;
     dir->pos = 0;
     return dir;
   } else {
     inode_close(inode);
-    free(dir);
+    slab_free(&dir_cache, dir);
     return NULL;
   }
 }
@@ -44,7 +54,7 @@ struct dir* dir_reopen(struct dir* dir) {
 void dir_close(struct dir* dir) {
   if (dir != NULL) {
     inode_close(dir->inode);
-    free(dir);
+    slab_free(&dir_cache, dir);
   }
 }
 
@@ -221,7 +231,6 @@ static int get_next_part(char part[NAME_MAX + 1], const char** srcp) {
 
 /* Get a directory from a path. */
 struct dir* get_dir_path(char* path, char curr_part[NAME_MAX + 1]) {
-  int return_num;
   if (path == NULL)
     return NULL;
 
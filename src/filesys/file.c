@@ -1,13 +1,23 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include <string.h>
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
+
+static void file_ctor(void*);
+
+/* Open files. */
+static struct slab_cache file_cache =
+    SLAB_CACHE_INITIALIZER(file_cache, "file", sizeof(struct file), file_ctor);
+
+/* Clears newly allocated FILE. */
+static void file_ctor(void* file) { memset(file, 0, sizeof(struct file)); }
 
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
 struct file* file_open(struct inode* inode) {
-  struct file* file = calloc(1, sizeof *file);
+  struct file* file = slab_alloc(&file_cache);
   if (inode != NULL && file != NULL) {
     file->inode = inode;
     file->pos = 0;
@@ -15,7 +25,7 @@ struct file* file_open(struct inode* inode) {
     return file;
   } else {
     inode_close(inode);
-    free(file);
+    slab_free(&file_cache, file);
     return NULL;
   }
 }
@@ -31,7 +41,7 @@ void file_close(struct file* file) {
   if (file != NULL) {
     file_allow_write(file);
     inode_close(file->inode);
-    free(file);
+    slab_free(&file_cache, file);
   }
 }
 
@@ -6,14 +6,16 @@
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
 #include "filesys/directory.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
 /* Global lock for free_map */
-struct lock free_map_lock;
+extern struct lock free_map_lock;
 
 /* Specifies length of buffer cache. */
 #define NUM_BLOCKS 64
@@ -33,6 +35,24 @@ static int num_hit;
 /* # of buffer cache accesses. */
 static int num_access;
 
+/* In-memory inodes. */
+static struct slab_cache inode_cache =
+    SLAB_CACHE_INITIALIZER(inode_cache, "inode", sizeof(struct inode), NULL);
+
+/* Sector-sized buffers: buffer cache blocks, on-disk inodes, and
+   indirect blocks. */
+static struct slab_cache sector_cache =
+    SLAB_CACHE_INITIALIZER(sector_cache, "sector", BLOCK_SECTOR_SIZE, NULL);
+
+/* Returns a new sector-sized buffer filled with zeros, or a null
+   pointer if memory is not available. */
+static void* sector_zalloc(void) {
+  void* buffer = slab_alloc(&sector_cache);
+  if (buffer != NULL)
+    memset(buffer, 0, BLOCK_SECTOR_SIZE);
+  return buffer;
+}
+
 /* Initialize buffer cache. */
 void buffer_init(void) {
   lock_init(&buffer_cache_lock);
@@ -40,7 +60,7 @@ void buffer_init(void) {
   num_access = 0;
   for (int i = 0; i < NUM_BLOCKS; i++) {
     buffer_block* block = &buffer_cache[i];
-    block->data = malloc(BLOCK_SECTOR_SIZE);
+    block->data = slab_alloc(&sector_cache);
     memset(block->data, 0, BLOCK_SECTOR_SIZE);
     block->free = true;
     block->dirty = false;
@@ -160,15 +180,35 @@ void buffer_write(block_sector_t sector, void* buffer, int offset, int size) {
   lock_release(&block->lock);
 }
 
-/* Flush the entire buffer cache to disk. */
+/* Completion function for buffer_flush()'s write-backs. */
+static void buffer_flush_done(struct block_request* r) { sema_up(r->aux); }
+
+/* Flush the entire buffer cache to disk.  All dirty blocks are
+ * queued at once so the device can sort and merge them. */
 void buffer_flush(void) {
+  static struct block_request requests[NUM_BLOCKS];
+  struct semaphore done;
+  int submitted = 0;
+  uint64_t start;
+
+  sema_init(&done, 0);
   lock_acquire(&buffer_cache_lock);
   for (int i = 0; i < NUM_BLOCKS; i++) {
     if (buffer_cache[i].dirty) {
-      block_write(fs_device, buffer_cache[i].sector, buffer_cache[i].data);
+      struct block_request* r = &requests[submitted++];
+      r->sector = buffer_cache[i].sector;
+      r->buffer = buffer_cache[i].data;
+      r->write = true;
+      r->done = buffer_flush_done;
+      r->aux = &done;
+      block_submit(fs_device, r);
       buffer_cache[i].dirty = false;
     }
   }
+  start = timer_tsc();
+  while (submitted-- > 0)
+    sema_down(&done);
+  thread_current()->usage.io_wait_us += timer_tsc_to_us(timer_tsc() - start);
   lock_release(&buffer_cache_lock);
 }
 
@@ -191,7 +231,7 @@ static block_sector_t byte_to_sector(const struct inode* inode, off_t pos) {
 
   block_sector_t result;
   /* Get inode_disk from inode */
-  struct inode_disk* inode_disk = malloc(sizeof *inode_disk);
+  struct inode_disk* inode_disk = slab_alloc(&sector_cache);
   buffer_read(inode->sector, inode_disk, 0, BLOCK_SECTOR_SIZE);
 
   /* Number of sectors up until (and including) the sector that POS(index) is. */
@@ -201,27 +241,27 @@ static block_sector_t byte_to_sector(const struct inode* inode, off_t pos) {
   if (target_sector_idx <= 123) {
     result = inode_disk->direct[target_sector_idx - 1];
   } else if (target_sector_idx <= 123 + 128) {
-    block_sector_t* direct_arr = malloc(128 * sizeof(block_sector_t));
+    block_sector_t* direct_arr = slab_alloc(&sector_cache);
     buffer_read(inode_disk->indirect, direct_arr, 0, BLOCK_SECTOR_SIZE);
     result = direct_arr[target_sector_idx - 124];
-    free(direct_arr);
+    slab_free(&sector_cache, direct_arr);
   } else if (target_sector_idx <= 123 + 128 + 128 * 128) {
-    block_sector_t* indirect_arr = malloc(128 * sizeof(block_sector_t));
+    block_sector_t* indirect_arr = slab_alloc(&sector_cache);
     buffer_read(inode_disk->doubly_indirect, indirect_arr, 0, BLOCK_SECTOR_SIZE);
 
     int idx = (target_sector_idx - 123 - 128 - 1) / 128;
     int offset = (target_sector_idx - 123 - 128 - 1) % 128;
 
     block_sector_t indirect_sector = indirect_arr[idx];
-    free(indirect_arr);
+    slab_free(&sector_cache, indirect_arr);
 
-    block_sector_t* direct_arr = malloc(128 * sizeof(block_sector_t));
+    block_sector_t* direct_arr = slab_alloc(&sector_cache);
     buffer_read(indirect_sector, direct_arr, 0, BLOCK_SECTOR_SIZE);
     result = direct_arr[offset];
-    free(direct_arr);
+    slab_free(&sector_cache, direct_arr);
   }
 
-  free(inode_disk);
+  slab_free(&sector_cache, inode_disk);
   return result;
 }
 
@@ -238,12 +278,12 @@ void inode_init(void) {
 
 bool inode_is_dir(struct inode* inode) {
   bool result = false;
-  struct inode_disk* inode_disk = malloc(sizeof *inode_disk);
+  struct inode_disk* inode_disk = slab_alloc(&sector_cache);
   buffer_read(inode->sector, inode_disk, 0, BLOCK_SECTOR_SIZE);
   if (inode_disk->is_dir) {
     result = true;
   }
-  free(inode_disk);
+  slab_free(&sector_cache, inode_disk);
   return result;
 }
 
@@ -264,7 +304,7 @@ static void inode_release(struct inode_disk* inode_disk, int starting_block, int
   }
 
   /* Release indirect pointer. */
-  block_sector_t* direct_arr = malloc(128 * sizeof(block_sector_t));
+  block_sector_t* direct_arr = slab_alloc(&sector_cache);
   buffer_read(inode_disk->indirect, direct_arr, 0, BLOCK_SECTOR_SIZE);
 
   if (starting_block <= 123) {
@@ -277,14 +317,14 @@ static void inode_release(struct inode_disk* inode_disk, int starting_block, int
     cur_block++;
 
     if (cur_block == end_block) {
-      free(direct_arr);
+      slab_free(&sector_cache, direct_arr);
       return;
     }
   }
-  free(direct_arr);
+  slab_free(&sector_cache, direct_arr);
 
   /* Read in doubly indirect pointer. */
-  block_sector_t* indirect_arr = malloc(128 * sizeof(block_sector_t));
+  block_sector_t* indirect_arr = slab_alloc(&sector_cache);
   buffer_read(inode_disk->doubly_indirect, indirect_arr, 0, BLOCK_SECTOR_SIZE);
 
   if (starting_block <= 123 + 128) {
@@ -296,7 +336,7 @@ static void inode_release(struct inode_disk* inode_disk, int starting_block, int
   int offset = (cur_block - 123 - 128) % 128;
 
   while (cur_block <= 122 + 128 + 128 * 128) {
-    block_sector_t* direct_arr = malloc(128 * sizeof(block_sector_t));
+    block_sector_t* direct_arr = slab_alloc(&sector_cache);
     buffer_read(indirect_arr[indirect_idx], direct_arr, 0, BLOCK_SECTOR_SIZE);
 
     if (starting_block <= 123 + 128 + indirect_idx * 128) {
@@ -312,17 +352,17 @@ static void inode_release(struct inode_disk* inode_disk, int starting_block, int
       offset++;
 
       if (cur_block == end_block) {
-        free(direct_arr);
-        free(indirect_arr);
+        slab_free(&sector_cache, direct_arr);
+        slab_free(&sector_cache, indirect_arr);
         return;
       }
     }
 
-    free(direct_arr);
+    slab_free(&sector_cache, direct_arr);
     indirect_idx++;
     offset = 0;
   }
-  free(indirect_arr);
+  slab_free(&sector_cache, indirect_arr);
 }
 
 /* Grow file's inode_disk to SIZE */
@@ -348,9 +388,9 @@ static bool inode_grow_file(struct inode_disk* inode_disk, off_t end_size) {
       return false;
     }
 
-    char* buffer = calloc(1, BLOCK_SECTOR_SIZE);
+    char* buffer = sector_zalloc();
     buffer_write(inode_disk->direct[cur_block], buffer, 0, BLOCK_SECTOR_SIZE);
-    free(buffer);
+    slab_free(&sector_cache, buffer);
     cur_block++;
 
     if (cur_block == end_block) {
@@ -359,7 +399,7 @@ static bool inode_grow_file(struct inode_disk* inode_disk, off_t end_size) {
   }
 
   /* Allocate indirect pointer. */
-  block_sector_t* direct_arr = malloc(128 * sizeof(block_sector_t));
+  block_sector_t* direct_arr = slab_alloc(&sector_cache);
   if (!inode_disk->indirect) {
     if (!free_map_allocate(1, &inode_disk->indirect)) {
       inode_release(inode_disk, starting_block, cur_block);
@@ -372,27 +412,27 @@ static bool inode_grow_file(struct inode_disk* inode_disk, off_t end_size) {
   while (cur_block <= 122 + 128) {
     if (!free_map_allocate(1, &direct_arr[cur_block - 123])) {
       inode_release(inode_disk, starting_block, cur_block);
-      free(direct_arr);
+      slab_free(&sector_cache, direct_arr);
       return false;
     }
 
-    char* buffer = calloc(1, BLOCK_SECTOR_SIZE);
+    char* buffer = sector_zalloc();
     buffer_write(direct_arr[cur_block - 123], buffer, 0, BLOCK_SECTOR_SIZE);
-    free(buffer);
+    slab_free(&sector_cache, buffer);
     cur_block++;
 
     if (cur_block == end_block) {
       buffer_write(inode_disk->indirect, direct_arr, 0, BLOCK_SECTOR_SIZE);
-      free(direct_arr);
+      slab_free(&sector_cache, direct_arr);
       return true;
     }
   }
 
   buffer_write(inode_disk->indirect, direct_arr, 0, BLOCK_SECTOR_SIZE);
-  free(direct_arr);
+  slab_free(&sector_cache, direct_arr);
 
   /* Allocate doubly indirect pointer. */
-  block_sector_t* indirect_arr = malloc(128 * sizeof(block_sector_t));
+  block_sector_t* indirect_arr = slab_alloc(&sector_cache);
   if (!inode_disk->doubly_indirect) {
     if (!free_map_allocate(1, &inode_disk->doubly_indirect)) {
       inode_release(inode_disk, starting_block, cur_block);
@@ -407,7 +447,7 @@ static bool inode_grow_file(struct inode_disk* inode_disk, off_t end_size) {
 
   while (cur_block <= 122 + 128 + 128 * 128) {
 
-    block_sector_t* direct_arr = malloc(128 * sizeof(block_sector_t));
+    block_sector_t* direct_arr = slab_alloc(&sector_cache);
     if (starting_block <= 123 + 128 + indirect_idx * 128) {
       /* Allocate indirect index */
       if (!free_map_allocate(1, &indirect_arr[indirect_idx])) {
@@ -422,34 +462,34 @@ static bool inode_grow_file(struct inode_disk* inode_disk, off_t end_size) {
       ASSERT(offset == offset % 128);
       if (!free_map_allocate(1, &direct_arr[offset])) {
         inode_release(inode_disk, starting_block, cur_block);
-        free(direct_arr);
-        free(indirect_arr);
+        slab_free(&sector_cache, direct_arr);
+        slab_free(&sector_cache, indirect_arr);
         return false;
       }
-      char* buffer = calloc(1, BLOCK_SECTOR_SIZE);
+      char* buffer = sector_zalloc();
       buffer_write(direct_arr[offset], buffer, 0, BLOCK_SECTOR_SIZE);
-      free(buffer);
+      slab_free(&sector_cache, buffer);
       cur_block++;
       offset++;
 
       if (cur_block == end_block) {
         buffer_write(indirect_arr[indirect_idx], direct_arr, 0, BLOCK_SECTOR_SIZE);
-        free(direct_arr);
+        slab_free(&sector_cache, direct_arr);
         buffer_write(inode_disk->doubly_indirect, indirect_arr, 0, BLOCK_SECTOR_SIZE);
-        free(indirect_arr);
+        slab_free(&sector_cache, indirect_arr);
         return true;
       }
     }
 
     buffer_write(indirect_arr[indirect_idx], direct_arr, 0, BLOCK_SECTOR_SIZE);
-    free(direct_arr);
+    slab_free(&sector_cache, direct_arr);
 
     indirect_idx++;
     offset = 0;
   }
 
   buffer_write(inode_disk->doubly_indirect, indirect_arr, 0, BLOCK_SECTOR_SIZE);
-  free(indirect_arr);
+  slab_free(&sector_cache, indirect_arr);
 
   /* Should never reach here.*/
   return true;
@@ -470,7 +510,7 @@ bool inode_create(block_sector_t sector, off_t length, int is_dir) {
      one sector in size, and you should fix that. */
   ASSERT(sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
-  disk_inode = calloc(1, sizeof *disk_inode);
+  disk_inode = sector_zalloc();
   if (disk_inode != NULL) {
     disk_inode->is_dir = is_dir;
     disk_inode->length = 0;
@@ -495,7 +535,7 @@ bool inode_create(block_sector_t sector, off_t length, int is_dir) {
     if (sector != FREE_MAP_SECTOR) {
       lock_release(&free_map_lock);
     }
-    free(disk_inode);
+    slab_free(&sector_cache, disk_inode);
   }
   return success;
 }
@@ -519,7 +559,7 @@ struct inode* inode_open(block_sector_t sector) {
   }
 
   /* Allocate memory. */
-  inode = malloc(sizeof *inode);
+  inode = slab_alloc(&inode_cache);
   if (inode == NULL) {
     lock_release(&open_inodes_lock);
     return NULL;
@@ -567,14 +607,14 @@ void inode_close(struct inode* inode) {
 
     /* Deallocate blocks if removed. */
     if (inode->removed) {
-      struct inode_disk* inode_disk = malloc(sizeof *inode_disk);
+      struct inode_disk* inode_disk = slab_alloc(&sector_cache);
       buffer_read(inode->sector, inode_disk, 0, BLOCK_SECTOR_SIZE);
       inode_release(inode_disk, 0, bytes_to_sectors(inode_disk->length));
-      free(inode_disk);
+      slab_free(&sector_cache, inode_disk);
       free_map_release(inode->sector, 1);
     }
     lock_release(&inode->inode_lock);
-    free(inode);
+    slab_free(&inode_cache, inode);
     return;
   } else {
     lock_release(&inode->inode_lock);
@@ -642,14 +682,14 @@ off_t inode_write_at(struct inode* inode, const void* buffer_, off_t size, off_t
 
   if (inode->sector != FREE_MAP_SECTOR) {
 
-    struct inode_disk* inode_disk = malloc(sizeof *inode_disk);
+    struct inode_disk* inode_disk = slab_alloc(&sector_cache);
     buffer_read(inode->sector, inode_disk, 0, BLOCK_SECTOR_SIZE);
     if (offset + size > inode_disk->length) {
       /* Need to grow file. */
       lock_acquire(&free_map_lock);
       if (!inode_grow_file(inode_disk, offset + size)) {
         lock_release(&free_map_lock);
-        free(inode_disk);
+        slab_free(&sector_cache, inode_disk);
         return 0; // Growing file failed.
       } else {
         inode_disk->length = offset + size;
@@ -657,7 +697,7 @@ off_t inode_write_at(struct inode* inode, const void* buffer_, off_t size, off_t
       }
       lock_release(&free_map_lock);
     }
-    free(inode_disk);
+    slab_free(&sector_cache, inode_disk);
   }
 
   while (size > 0) {
@@ -706,9 +746,9 @@ void inode_allow_write(struct inode* inode) {
 
 /* Returns the length, in bytes, of INODE's data. */
 off_t inode_length(const struct inode* inode) {
-  struct inode_disk* inode_disk = malloc(sizeof(struct inode_disk));
+  struct inode_disk* inode_disk = slab_alloc(&sector_cache);
   buffer_read(inode->sector, inode_disk, 0, BLOCK_SECTOR_SIZE);
   off_t result = inode_disk->length;
-  free(inode_disk);
+  slab_free(&sector_cache, inode_disk);
   return result;
 }
@@ -0,0 +1,25 @@
+#ifndef __LIB_IOSTAT_H
+#define __LIB_IOSTAT_H
+
+/* Block device I/O statistics, shared between the kernel and
+   user programs (see the iostat() system call). */
+
+#include <stdint.h>
+
+/* Number of latency histogram buckets.  Bucket I counts requests
+   that completed in [2**I, 2**(I+1)) microseconds; bucket 0 also
+   counts faster ones and the last bucket also counts slower
+   ones. */
+#define IOSTAT_BUCKETS 24
+
+/* Statistics for one block device. */
+struct iostat {
+  uint64_t bytes_read;                     /* Bytes read. */
+  uint64_t bytes_written;                  /* Bytes written. */
+  uint32_t read_latency[IOSTAT_BUCKETS];   /* Read latency histogram. */
+  uint32_t write_latency[IOSTAT_BUCKETS];  /* Write latency histogram. */
+  uint32_t queue_depth;                    /* Requests now queued or in flight. */
+  uint32_t max_queue_depth;                /* Most requests ever queued or in flight. */
+};
+
+#endif /* lib/iostat.h */
@@ -0,0 +1,123 @@
+#include "wheel.h"
+#include "../debug.h"
+
+static void place(struct wheel*, struct wheel_elem*);
+static int cascade(struct wheel*, int level);
+
+/* Returns the slot index at LEVEL for time T. */
+static inline int slot_index(int64_t t, int level) {
+  return (t >> (level * WHEEL_BITS)) & (WHEEL_SLOTS - 1);
+}
+
+/* Initializes wheel W as empty, with its clock set to NOW. */
+void wheel_init(struct wheel* w, int64_t now) {
+  int level, slot;
+
+  ASSERT(w != NULL);
+
+  w->now = now;
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (slot = 0; slot < WHEEL_SLOTS; slot++)
+      list_init(&w->slots[level][slot]);
+}
+
+/* Inserts E into wheel W to expire at time EXPIRES.  If EXPIRES
+   is not after W's current time, E expires the next time the
+   wheel is advanced. */
+void wheel_insert(struct wheel* w, struct wheel_elem* e, int64_t expires) {
+  ASSERT(w != NULL);
+  ASSERT(e != NULL);
+
+  e->expires = expires > w->now ? expires : w->now + 1;
+  place(w, e);
+}
+
+/* Removes E, which must be in a wheel, from its wheel. */
+void wheel_remove(struct wheel_elem* e) {
+  ASSERT(e != NULL);
+  list_remove(&e->list_elem);
+}
+
+/* Advances wheel W's clock to NOW, one tick at a time, and moves
+   every element that expires at or before NOW onto the end of
+   EXPIRED, in order of expiration. */
+void wheel_advance(struct wheel* w, int64_t now, struct list* expired) {
+  ASSERT(w != NULL);
+  ASSERT(expired != NULL);
+
+  while (w->now < now) {
+    struct list* slot;
+    int level;
+
+    w->now++;
+
+    /* At the start of each level-N period, redistribute the
+       level-(N+1) slot that covers it, continuing up the levels
+       for as long as we are at the start of those, too. */
+    for (level = 1; level < WHEEL_LEVELS; level++)
+      if (slot_index(w->now, level - 1) != 0 || cascade(w, level) != 0)
+        break;
+
+    slot = &w->slots[0][slot_index(w->now, 0)];
+    while (!list_empty(slot))
+      list_push_back(expired, list_pop_front(slot));
+  }
+}
+
+/* Returns the earliest time after W's current time, and no
+   later than LIMIT, at which advancing W might expire an element,
+   or LIMIT if there is none.  The answer is exact for elements
+   due before the next level-1 boundary; past that boundary, it is
+   the boundary itself, because a cascade may bring elements due
+   at any time.  Takes time proportional to the result minus W's
+   current time. */
+int64_t wheel_next(struct wheel* w, int64_t limit) {
+  int64_t t;
+
+  ASSERT(w != NULL);
+
+  for (t = w->now + 1; t < limit; t++)
+    if (slot_index(t, 0) == 0 || !list_empty(&w->slots[0][slot_index(t, 0)]))
+      return t;
+  return limit;
+}
+
+/* Puts E, whose expiration time is not before W's current time,
+   into the slot of W that covers its expiration time. */
+static void place(struct wheel* w, struct wheel_elem* e) {
+  int64_t expires = e->expires;
+  int64_t delta = expires - w->now;
+  int level;
+
+  ASSERT(delta >= 0);
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    if (delta < (int64_t)1 << ((level + 1) * WHEEL_BITS))
+      break;
+  if (level == WHEEL_LEVELS) {
+    /* Beyond the wheel's span: park it in the last slot the
+       wheel reaches; it is placed again when that slot
+       cascades. */
+    level = WHEEL_LEVELS - 1;
+    expires = w->now + ((int64_t)1 << (WHEEL_LEVELS * WHEEL_BITS)) - 1;
+  }
+
+  list_push_back(&w->slots[level][slot_index(expires, level)], &e->list_elem);
+}
+
+/* Redistributes the elements in the LEVEL slot of W that covers
+   W's current time into finer levels.  Returns that slot's
+   index. */
+static int cascade(struct wheel* w, int level) {
+  int index = slot_index(w->now, level);
+  struct list* slot = &w->slots[level][index];
+  struct list pending;
+
+  list_init(&pending);
+  while (!list_empty(slot))
+    list_push_back(&pending, list_pop_front(slot));
+  while (!list_empty(&pending))
+    place(w, list_entry(list_pop_front(&pending), struct wheel_elem, list_elem));
+
+  return index;
+}
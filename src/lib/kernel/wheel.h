@@ -0,0 +1,63 @@
+#ifndef __LIB_KERNEL_WHEEL_H
+#define __LIB_KERNEL_WHEEL_H
+
+/* Hierarchical timer wheel.
+
+   A timer wheel holds elements keyed by an expiration time, in
+   abstract "ticks", and hands them back once the wheel's clock
+   has been advanced past that time.  Insertion and removal take
+   constant time, and advancing the clock by one tick takes time
+   proportional to the number of elements that expire plus,
+   occasionally, the number that cascade from a coarser level to
+   a finer one.
+
+   The wheel has WHEEL_LEVELS levels of WHEEL_SLOTS slots each.
+   Level 0 has one slot per tick for the next WHEEL_SLOTS ticks;
+   each higher level covers WHEEL_SLOTS times as many ticks per
+   slot.  When the clock reaches the start of a slot's range in
+   some level, that slot's elements are redistributed into finer
+   levels.  Elements further in the future than the wheel spans
+   wait in its last slot and are redistributed again as needed.
+
+   Like the list and hash table, the wheel does no dynamic
+   allocation: each structure that can be on a wheel embeds a
+   struct wheel_elem.  Use wheel_entry() to get back from the
+   wheel_elem to the structure that contains it.
+
+   The wheel does no locking of its own. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "list.h"
+
+#define WHEEL_BITS 6                  /* Bits of time per level. */
+#define WHEEL_SLOTS (1 << WHEEL_BITS) /* Slots per level. */
+#define WHEEL_LEVELS 4                /* Number of levels. */
+
+/* Wheel element. */
+struct wheel_elem {
+  struct list_elem list_elem; /* Element in a slot. */
+  int64_t expires;            /* Expiration time. */
+};
+
+/* Converts pointer to wheel element WHEEL_ELEM into a pointer to
+   the structure that WHEEL_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the wheel element. */
+#define wheel_entry(WHEEL_ELEM, STRUCT, MEMBER)                                                    \
+  ((STRUCT*)((uint8_t*)&(WHEEL_ELEM)->list_elem - offsetof(STRUCT, MEMBER.list_elem)))
+
+/* Timer wheel. */
+struct wheel {
+  int64_t now;                                    /* Current time. */
+  struct list slots[WHEEL_LEVELS][WHEEL_SLOTS];   /* Pending elements. */
+};
+
+void wheel_init(struct wheel*, int64_t now);
+void wheel_insert(struct wheel*, struct wheel_elem*, int64_t expires);
+void wheel_remove(struct wheel_elem*);
+void wheel_advance(struct wheel*, int64_t now, struct list* expired);
+int64_t wheel_next(struct wheel*, int64_t limit);
+
+#endif /* lib/kernel/wheel.h */
@@ -0,0 +1,59 @@
+#ifndef __LIB_MEMSTAT_H
+#define __LIB_MEMSTAT_H
+
+/* Kernel memory usage, shared between the kernel and user
+   programs (see the memstat() system call). */
+
+#include <stdint.h>
+
+/* Number of malloc() size classes, 16 bytes through 1 kB. */
+#define MEMSTAT_CLASS_CNT 7
+
+/* Maximum number of allocation sites reported. */
+#define MEMSTAT_SITE_CNT 16
+
+/* A page pool. */
+struct memstat_pool {
+  uint32_t pages;    /* Pages in the pool. */
+  uint32_t used;     /* Pages allocated. */
+  uint32_t max_used; /* Most pages allocated at once. */
+  uint64_t allocs;   /* Successful allocation calls. */
+  uint64_t failures; /* Failed allocation calls. */
+  uint64_t frees;    /* Free calls. */
+};
+
+/* A malloc() size class. */
+struct memstat_class {
+  uint32_t block_size; /* Size of each block in bytes. */
+  uint32_t arenas;     /* Pages held for blocks of this size. */
+  uint32_t max_arenas; /* Most pages held at once. */
+  uint64_t allocs;     /* Blocks allocated. */
+  uint64_t frees;      /* Blocks freed. */
+};
+
+/* A place in the kernel that called malloc(), calloc(), or
+   realloc(), with the blocks it allocated that have not been
+   freed. */
+struct memstat_site {
+  uint32_t caller; /* Return address of the call. */
+  uint32_t blocks; /* Blocks outstanding. */
+  uint32_t bytes;  /* Bytes requested for them. */
+};
+
+/* Kernel memory usage. */
+struct memstat {
+  struct memstat_pool kernel_pool;                 /* Kernel page pool. */
+  struct memstat_pool user_pool;                   /* User page pool. */
+  struct memstat_class classes[MEMSTAT_CLASS_CNT]; /* malloc() size classes. */
+  uint64_t big_allocs;                             /* malloc() blocks over 1 kB allocated. */
+  uint64_t big_frees;                              /* ...and freed. */
+  uint32_t big_pages;                              /* Pages held by them. */
+
+  /* Only with allocation-site tagging (kernel option "-memtag"),
+     the sites with the most bytes outstanding, most first. */
+  struct memstat_site sites[MEMSTAT_SITE_CNT]; /* Allocation sites. */
+  uint32_t site_cnt;                           /* Number of SITES filled in. */
+  uint32_t untagged;                           /* Blocks not tagged: table was full. */
+};
+
+#endif /* lib/memstat.h */
@@ -0,0 +1,23 @@
+#ifndef __LIB_RUSAGE_H
+#define __LIB_RUSAGE_H
+
+/* Per-process resource usage, shared between the kernel and user
+   programs (see the getrusage() system call). */
+
+#include <stdint.h>
+
+/* Whose usage getrusage() reports. */
+#define RUSAGE_SELF 0      /* The calling process. */
+#define RUSAGE_CHILDREN -1 /* Its children that have exited and been waited for. */
+
+/* Resource usage of a thread or process. */
+struct rusage {
+  uint64_t user_ticks;           /* Timer ticks spent running in user mode. */
+  uint64_t kernel_ticks;         /* Timer ticks spent running in the kernel. */
+  uint32_t voluntary_switches;   /* Gave up the CPU to block or exit. */
+  uint32_t involuntary_switches; /* Gave up the CPU while still runnable. */
+  uint64_t lock_wait_us;         /* Microseconds blocked acquiring locks. */
+  uint64_t io_wait_us;           /* Microseconds blocked on block device I/O. */
+};
+
+#endif /* lib/rusage.h */
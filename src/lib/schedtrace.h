@@ -0,0 +1,37 @@
+#ifndef __LIB_SCHEDTRACE_H
+#define __LIB_SCHEDTRACE_H
+
+/* Scheduler trace events, shared between the kernel and user
+   programs (see the schedtrace() system call).  The kernel
+   records them in a ring buffer when started with -schedtrace;
+   utils/pintos-schedtrace turns a dump of them into per-thread
+   timelines. */
+
+#include <stdint.h>
+
+/* Number of most recent events that the kernel keeps. */
+#define SCHEDTRACE_SIZE 1024
+
+/* Kinds of scheduler events. */
+enum schedtrace_type {
+  SCHEDTRACE_SWITCH,  /* TID gave up the CPU to OTHER. */
+  SCHEDTRACE_BLOCK,   /* TID blocked. */
+  SCHEDTRACE_UNBLOCK, /* TID was made ready by OTHER. */
+  SCHEDTRACE_PRIORITY /* TID's effective priority changed, e.g. by donation. */
+};
+
+/* One scheduler event.  FROM and TO are the thread states before
+   and after the event: 0 for running, 1 for ready, 2 for blocked,
+   3 for dying. */
+struct schedtrace_event {
+  int64_t tick;     /* Timer ticks since boot. */
+  uint64_t tsc;     /* CPU time-stamp counter. */
+  int32_t tid;      /* Thread the event is about. */
+  int32_t other;    /* Other thread involved, or -1. */
+  uint8_t type;     /* An enum schedtrace_type. */
+  uint8_t from;     /* State of TID before the event. */
+  uint8_t to;       /* State of TID after the event. */
+  uint8_t priority; /* Effective priority of TID after the event. */
+};
+
+#endif /* lib/schedtrace.h */
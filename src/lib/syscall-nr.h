@@ -31,7 +31,13 @@ enum {
   SYS_MKDIR,   /* Create a directory. */
   SYS_READDIR, /* Reads a directory entry. */
   SYS_ISDIR,   /* Tests if a fd represents a directory. */
-  SYS_INUMBER  /* Returns the inode number for a fd. */
+  SYS_INUMBER, /* Returns the inode number for a fd. */
+
+  /* Instrumentation. */
+  SYS_IOSTAT,     /* Get I/O statistics for a block device. */
+  SYS_SCHEDTRACE, /* Read recent scheduler events. */
+  SYS_GETRUSAGE,  /* Get resource usage of this process or its children. */
+  SYS_MEMSTAT     /* Get kernel memory usage. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -108,3 +108,15 @@ int num_buffer_hit(void) { return syscall0(SYS_HIT); }
 int num_buffer_access(void) { return syscall0(SYS_BUFACC); }
 
 unsigned long long disk_write_cnt(void) { return syscall0(SYS_DWCNT); }
+
+bool iostat(const char* device, struct iostat* stats) {
+  return syscall2(SYS_IOSTAT, device, stats);
+}
+
+int schedtrace(struct schedtrace_event* events, int max) {
+  return syscall2(SYS_SCHEDTRACE, events, max);
+}
+
+bool getrusage(int who, struct rusage* usage) { return syscall2(SYS_GETRUSAGE, who, usage); }
+
+bool memstat(struct memstat* stats) { return syscall1(SYS_MEMSTAT, stats); }
@@ -3,6 +3,10 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <iostat.h>
+#include <memstat.h>
+#include <rusage.h>
+#include <schedtrace.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -49,4 +53,10 @@ int num_buffer_hit(void);
 int num_buffer_access(void);
 unsigned long long disk_write_cnt(void);
 
+/* Instrumentation. */
+bool iostat(const char* device, struct iostat*);
+int schedtrace(struct schedtrace_event*, int max);
+bool getrusage(int who, struct rusage*);
+bool memstat(struct memstat*);
+
 #endif /* lib/user/syscall.h */
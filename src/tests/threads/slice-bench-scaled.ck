@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing time slice line in output"
+  unless grep (/^\(slice-bench-scaled\) time slice \d+ ticks, (fixed|scaled by priority)$/, @output);
+fail "missing batch results in output"
+  unless grep (/^\(slice-bench-scaled\) batch: \d+ iterations, \d+ involuntary switches$/, @output);
+fail "missing interactive results in output"
+  unless grep (/^\(slice-bench-scaled\) interactive: \d+ wakeups, \d+ ticks late in total, \d+ at most$/, @output);
+
+pass;
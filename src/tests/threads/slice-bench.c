@@ -0,0 +1,133 @@
+/* Measures the trade-off that the time slice controls.
+
+   BATCH_CNT low-priority "batch" threads spin for RUN_TICKS
+   ticks, counting loop iterations, as a measure of throughput,
+   and involuntary context switches.  Meanwhile INTERACTIVE_CNT
+   higher-priority "interactive" threads repeatedly work for
+   BURST_TICKS ticks and then sleep for a tick, recording how many
+   ticks late each one gets back from its sleep onto the CPU, as a
+   measure of dispatch latency.
+
+   Compare the output under different -slice and -slice-scale
+   settings: slice-bench-scaled runs it with -slice-scale. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define RUN_TICKS (5 * TIMER_FREQ)
+#define BATCH_CNT 3
+#define BATCH_PRIORITY (PRI_DEFAULT - 16)
+#define INTERACTIVE_CNT 2
+#define INTERACTIVE_PRIORITY (PRI_DEFAULT + 10)
+#define BURST_TICKS 3
+
+struct bench {
+  int64_t end;           /* Tick at which to stop. */
+  struct semaphore done; /* Upped by each thread as it finishes. */
+  struct lock lock;      /* Protects the totals below. */
+  int64_t iterations;    /* Batch loop iterations. */
+  uint32_t switches;     /* Batch involuntary switches. */
+  int wakeups;           /* Interactive wakeups. */
+  int64_t lateness;      /* Total ticks interactive threads ran late. */
+  int64_t max_lateness;  /* Most ticks any wakeup ran late. */
+};
+
+static thread_func batch_thread;
+static thread_func interactive_thread;
+
+static void slice_bench(void) {
+  struct bench b;
+  char name[16];
+  int i;
+
+  sema_init(&b.done, 0);
+  lock_init(&b.lock);
+  b.iterations = 0;
+  b.switches = 0;
+  b.wakeups = 0;
+  b.lateness = 0;
+  b.max_lateness = 0;
+
+  msg("time slice %u ticks, %s", thread_time_slice,
+      thread_slice_scaled ? "scaled by priority" : "fixed");
+
+  b.end = timer_ticks() + RUN_TICKS;
+  for (i = 0; i < BATCH_CNT; i++) {
+    snprintf(name, sizeof name, "batch %d", i);
+    thread_create(name, BATCH_PRIORITY, batch_thread, &b);
+  }
+  for (i = 0; i < INTERACTIVE_CNT; i++) {
+    snprintf(name, sizeof name, "interactive %d", i);
+    thread_create(name, INTERACTIVE_PRIORITY, interactive_thread, &b);
+  }
+
+  timer_sleep(RUN_TICKS);
+  for (i = 0; i < BATCH_CNT + INTERACTIVE_CNT; i++)
+    sema_down(&b.done);
+
+  msg("batch: %lld iterations, %u involuntary switches", b.iterations, b.switches);
+  msg("interactive: %d wakeups, %lld ticks late in total, %lld at most", b.wakeups, b.lateness,
+      b.max_lateness);
+}
+
+void test_slice_bench(void) {
+  ASSERT(!thread_mlfqs);
+  slice_bench();
+}
+
+void test_slice_bench_scaled(void) {
+  ASSERT(!thread_mlfqs);
+  ASSERT(thread_slice_scaled);
+  slice_bench();
+}
+
+/* Spins until the end of the run, counting iterations. */
+static void batch_thread(void* b_) {
+  struct bench* b = b_;
+  int64_t iterations = 0;
+
+  while (timer_ticks() < b->end)
+    iterations++;
+
+  lock_acquire(&b->lock);
+  b->iterations += iterations;
+  b->switches += thread_current()->usage.involuntary_switches;
+  lock_release(&b->lock);
+  sema_up(&b->done);
+}
+
+/* Alternates bursts of work with one-tick sleeps until the end of
+   the run, measuring how late it resumes after each sleep. */
+static void interactive_thread(void* b_) {
+  struct bench* b = b_;
+  int64_t lateness = 0, max_lateness = 0;
+  int wakeups = 0;
+
+  while (timer_ticks() < b->end) {
+    int64_t start = timer_ticks();
+    int64_t late;
+
+    while (timer_elapsed(start) < BURST_TICKS)
+      continue;
+
+    start = timer_ticks();
+    timer_sleep(1);
+    late = timer_elapsed(start) - 1;
+    lateness += late;
+    if (late > max_lateness)
+      max_lateness = late;
+    wakeups++;
+  }
+
+  lock_acquire(&b->lock);
+  b->wakeups += wakeups;
+  b->lateness += lateness;
+  if (max_lateness > b->max_lateness)
+    b->max_lateness = max_lateness;
+  lock_release(&b->lock);
+  sema_up(&b->done);
+}
@@ -0,0 +1,98 @@
+/* Checks that other CPUs run threads created on the bootstrap
+   processor.
+
+   The main thread creates THREAD_CNT threads that each spin for
+   SPIN_TICKS ticks and record which CPU they ran on.  They all
+   become ready on the bootstrap processor's run queue, so they
+   can only run elsewhere if the other CPUs steal them.  Must run
+   with at least two CPUs (see the --smp option to "pintos"). */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 8
+#define SPIN_TICKS (TIMER_FREQ / 10)
+
+struct spin {
+  struct semaphore done; /* Upped by each thread as it finishes. */
+  uint32_t cpu_mask;     /* Bit N set if a thread ran on CPU N. */
+};
+
+static thread_func spin_thread;
+static uint64_t total_steals(void);
+static int popcount(uint32_t);
+
+void test_smp_steal(void) {
+  struct spin s;
+  uint64_t steals;
+  int online = 0;
+  int i;
+
+  ASSERT(!thread_mlfqs);
+
+  for (i = 0; i < cpu_cnt; i++)
+    if (cpus[i].online)
+      online++;
+  if (online < 2)
+    fail("%d CPU(s) online, but this test needs at least 2.", online);
+  msg("%d CPUs online.", online);
+
+  sema_init(&s.done, 0);
+  s.cpu_mask = 0;
+  steals = total_steals();
+
+  for (i = 0; i < THREAD_CNT; i++) {
+    char name[16];
+    snprintf(name, sizeof name, "spin %d", i);
+    thread_create(name, PRI_DEFAULT, spin_thread, &s);
+  }
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down(&s.done);
+
+  if (popcount(s.cpu_mask) < 2)
+    fail("All threads ran on one CPU.");
+  msg("Spinners ran on more than one CPU.");
+  if (total_steals() <= steals)
+    fail("No CPU stole a ready thread.");
+  msg("Other CPUs stole ready threads.");
+}
+
+/* Spins for SPIN_TICKS ticks, recording each CPU it runs on. */
+static void spin_thread(void* s_) {
+  struct spin* s = s_;
+  int64_t start = timer_ticks();
+
+  while (timer_elapsed(start) < SPIN_TICKS) {
+    enum intr_level old_level = intr_disable();
+    s->cpu_mask |= 1u << cpu_current()->id;
+    intr_set_level(old_level);
+  }
+  sema_up(&s->done);
+}
+
+/* Returns the number of threads that all CPUs have stolen. */
+static uint64_t total_steals(void) {
+  enum intr_level old_level = intr_disable();
+  uint64_t steals = 0;
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    steals += cpus[i].steals;
+  intr_set_level(old_level);
+  return steals;
+}
+
+/* Returns the number of bits set in X. */
+static int popcount(uint32_t x) {
+  int cnt = 0;
+
+  for (; x != 0; x &= x - 1)
+    cnt++;
+  return cnt;
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(smp-steal) begin
+(smp-steal) 2 CPUs online.
+(smp-steal) Spinners ran on more than one CPU.
+(smp-steal) Other CPUs stole ready threads.
+(smp-steal) end
+EOF
+pass;
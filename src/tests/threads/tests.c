@@ -36,6 +36,11 @@ static const struct test tests[] = {
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"slice-bench", test_slice_bench},
+    {"slice-bench-scaled", test_slice_bench_scaled},
+    {"smp-steal", test_smp_steal},
+    {"workqueue", test_workqueue},
+    {"timeout-wheel", test_timeout_wheel},
 };
 
 static const char* test_name;
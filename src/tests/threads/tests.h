@@ -32,6 +32,11 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_slice_bench;
+extern test_func test_slice_bench_scaled;
+extern test_func test_smp_steal;
+extern test_func test_workqueue;
+extern test_func test_timeout_wheel;
 
 void msg(const char*, ...);
 void fail(const char*, ...);
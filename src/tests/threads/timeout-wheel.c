@@ -0,0 +1,136 @@
+/* Checks timeouts and the timer wheel that holds them.
+
+   Adds timeouts, out of order, due on both sides of the wheel's
+   64- and 4096-tick level boundaries, so that they must cascade
+   from coarser levels to finer ones, and cancels some of them
+   before they are due.  Checks that the others fire in order of
+   expiration, none before it is due, and that the cancelled ones
+   never fire.
+
+   Then, on a wheel of its own whose clock it advances directly,
+   checks that an element due beyond the wheel's span is parked
+   and placed again until it expires on time. */
+
+#include <stdio.h>
+#include <wheel.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* A timeout under test. */
+struct entry {
+  struct timeout timeout; /* The timeout. */
+  int64_t delay;          /* Ticks after the start that it is due. */
+  bool cancel;            /* Cancel it before it is due? */
+  int64_t fired;          /* Ticks after the start that it fired, or -1. */
+};
+
+static struct entry entries[] = {
+    {.delay = 4100}, {.delay = 10},  {.delay = 70, .cancel = true},
+    {.delay = 4000}, {.delay = 130}, {.delay = 4200},
+    {.delay = 63},   {.delay = 65},  {.delay = 4099, .cancel = true},
+};
+#define ENTRY_CNT (sizeof entries / sizeof *entries)
+
+static int64_t start;            /* Tick at which the timeouts were added. */
+static struct semaphore done;    /* Upped when every uncancelled timeout fired. */
+static size_t order[ENTRY_CNT];  /* Entries in the order they fired. */
+static size_t order_cnt;         /* Number of entries in ORDER. */
+static size_t wait_cnt;          /* Number of entries that should fire. */
+
+static timeout_func record_timeout;
+static void test_beyond_span(void);
+
+void test_timeout_wheel(void) {
+  int64_t last_delay = 0;
+  size_t i;
+
+  ASSERT(!thread_mlfqs);
+
+  sema_init(&done, 0);
+  start = timer_ticks();
+  for (i = 0; i < ENTRY_CNT; i++) {
+    struct entry* e = &entries[i];
+    e->fired = -1;
+    timeout_add(&e->timeout, start + e->delay, record_timeout, e);
+  }
+  for (i = 0; i < ENTRY_CNT; i++) {
+    struct entry* e = &entries[i];
+    if (e->cancel) {
+      if (!timeout_cancel(&e->timeout))
+        fail("could not cancel timeout due after %lld ticks", e->delay);
+    } else
+      wait_cnt++;
+    if (e->delay > last_delay)
+      last_delay = e->delay;
+  }
+
+  sema_down(&done);
+
+  /* Give the cancelled timeouts time to fire if they were going
+     to. */
+  timer_sleep(start + last_delay + 2 - timer_ticks());
+
+  for (i = 0; i < order_cnt; i++) {
+    const struct entry* e = &entries[order[i]];
+    if (e->cancel)
+      fail("cancelled timeout due after %lld ticks fired", e->delay);
+    if (e->fired < e->delay)
+      fail("timeout due after %lld ticks fired after %lld", e->delay, e->fired);
+    if (i > 0 && e->delay < entries[order[i - 1]].delay)
+      fail("timeout due after %lld ticks fired after one due after %lld", e->delay,
+           entries[order[i - 1]].delay);
+    msg("timeout due after %lld ticks fired", e->delay);
+  }
+  if (order_cnt != wait_cnt)
+    fail("%zu timeouts fired, not %zu", order_cnt, wait_cnt);
+  for (i = 0; i < ENTRY_CNT; i++)
+    if (!entries[i].cancel && timeout_cancel(&entries[i].timeout))
+      fail("timeout due after %lld ticks was still pending", entries[i].delay);
+
+  test_beyond_span();
+}
+
+/* Records that the entry E_ fired.  Runs in the timer interrupt
+   handler. */
+static void record_timeout(void* e_) {
+  struct entry* e = e_;
+
+  e->fired = timer_ticks() - start;
+  order[order_cnt++] = e - entries;
+  if (order_cnt == wait_cnt)
+    sema_up(&done);
+}
+
+/* Checks that an element due beyond the span of a wheel expires
+   on time, after one due just inside the span. */
+static void test_beyond_span(void) {
+  static struct wheel w;
+  const int64_t span = (int64_t)1 << (WHEEL_LEVELS * WHEEL_BITS);
+  const int64_t now = 1000;
+  struct wheel_elem inside, beyond;
+  struct list expired;
+
+  wheel_init(&w, now);
+  wheel_insert(&w, &beyond, now + span + 100);
+  wheel_insert(&w, &inside, now + span - 10);
+  list_init(&expired);
+
+  wheel_advance(&w, now + span - 11, &expired);
+  if (!list_empty(&expired))
+    fail("element expired early");
+  wheel_advance(&w, now + span - 10, &expired);
+  if (list_size(&expired) != 1 || list_front(&expired) != &inside.list_elem)
+    fail("element inside the wheel's span did not expire on time");
+  list_init(&expired);
+  wheel_advance(&w, now + span + 99, &expired);
+  if (!list_empty(&expired))
+    fail("element beyond the wheel's span expired early");
+  wheel_advance(&w, now + span + 100, &expired);
+  if (list_size(&expired) != 1 || list_front(&expired) != &beyond.list_elem)
+    fail("element beyond the wheel's span did not expire on time");
+  msg("element beyond the wheel's span expired on time");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(timeout-wheel) begin
+(timeout-wheel) timeout due after 10 ticks fired
+(timeout-wheel) timeout due after 63 ticks fired
+(timeout-wheel) timeout due after 65 ticks fired
+(timeout-wheel) timeout due after 130 ticks fired
+(timeout-wheel) timeout due after 4000 ticks fired
+(timeout-wheel) timeout due after 4100 ticks fired
+(timeout-wheel) timeout due after 4200 ticks fired
+(timeout-wheel) element beyond the wheel's span expired on time
+(timeout-wheel) end
+EOF
+pass;
@@ -0,0 +1,97 @@
+/* Checks the work queue.
+
+   The main thread, at the highest priority so that no worker can
+   run yet, schedules work items at mixed priorities, one with a
+   delay, and two more that it cancels, one pending and one
+   waiting out its delay.  Then it waits for the items to run and
+   checks that they ran highest priority first, FIFO among equal
+   priorities, that the delayed one waited out its delay, and
+   that the cancelled ones never ran. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
+
+#define DELAY 20
+
+/* Items that run. */
+enum { HIGH_1, HIGH_2, MIDDLE, LOW, DELAYED, RUN_CNT };
+
+static const char* names[RUN_CNT] = {"high 1", "high 2", "middle", "low", "delayed"};
+
+static struct semaphore done;  /* Upped by each item that runs. */
+static int order[RUN_CNT + 2]; /* Items in the order they ran. */
+static int order_cnt;          /* Number of items in ORDER. */
+static int64_t delayed_ticks;  /* Ticks the delayed item waited. */
+static int64_t start;          /* When the delayed item was scheduled. */
+
+static work_func record_work;
+static void check(bool success, const char* failure);
+
+void test_workqueue(void) {
+  struct work runs[RUN_CNT];
+  struct work cancel_pending, cancel_delayed;
+  int i;
+
+  ASSERT(!thread_mlfqs);
+
+  sema_init(&done, 0);
+  for (i = 0; i < RUN_CNT; i++)
+    work_init(&runs[i], record_work, (void*)i);
+  work_init(&cancel_pending, record_work, (void*)RUN_CNT);
+  work_init(&cancel_delayed, record_work, (void*)(RUN_CNT + 1));
+
+  thread_set_priority(PRI_MAX);
+  start = timer_ticks();
+  check(work_schedule_after(&runs[DELAYED], PRI_MAX, DELAY), "could not delay item");
+  check(work_schedule(&runs[LOW], PRI_MIN), "could not schedule low item");
+  check(work_schedule(&runs[HIGH_1], PRI_DEFAULT + 10), "could not schedule high item");
+  check(work_schedule(&runs[MIDDLE], PRI_DEFAULT), "could not schedule middle item");
+  check(work_schedule(&runs[HIGH_2], PRI_DEFAULT + 10), "could not schedule high item");
+  check(!work_schedule(&runs[MIDDLE], PRI_MAX), "rescheduled pending item");
+  check(!work_schedule_after(&runs[MIDDLE], PRI_MAX, 1), "delayed pending item");
+  check(!work_schedule_after(&runs[DELAYED], PRI_MIN, 1), "delayed item twice");
+
+  check(work_schedule(&cancel_pending, PRI_MAX), "could not schedule item to cancel");
+  check(work_schedule_after(&cancel_delayed, PRI_MAX, DELAY / 2),
+        "could not delay item to cancel");
+  check(work_cancel(&cancel_pending), "could not cancel pending item");
+  check(work_cancel(&cancel_delayed), "could not cancel delayed item");
+  check(!work_cancel(&cancel_pending), "cancelled item twice");
+  thread_set_priority(PRI_DEFAULT);
+
+  for (i = 0; i < RUN_CNT; i++)
+    sema_down(&done);
+
+  /* Give the cancelled items time to run if they were going to. */
+  timer_sleep(DELAY);
+
+  for (i = 0; i < order_cnt; i++)
+    msg("%s ran", order[i] < RUN_CNT ? names[order[i]] : "cancelled item");
+  if (delayed_ticks < DELAY)
+    fail("delayed item ran after %lld ticks, not %d", delayed_ticks, DELAY);
+  msg("delayed item waited out its delay");
+}
+
+/* Records that the item numbered by W's aux ran. */
+static void record_work(struct work* w) {
+  int id = (int)w->aux;
+  enum intr_level old_level = intr_disable();
+
+  if (id == DELAYED)
+    delayed_ticks = timer_elapsed(start);
+  order[order_cnt++] = id;
+  intr_set_level(old_level);
+  sema_up(&done);
+}
+
+/* Fails the test with message FAILURE unless SUCCESS. */
+static void check(bool success, const char* failure) {
+  if (!success)
+    fail("%s", failure);
+}
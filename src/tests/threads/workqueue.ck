@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue) begin
+(workqueue) high 1 ran
+(workqueue) high 2 ran
+(workqueue) middle ran
+(workqueue) low ran
+(workqueue) delayed ran
+(workqueue) delayed item waited out its delay
+(workqueue) end
+EOF
+pass;
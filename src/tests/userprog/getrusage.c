@@ -0,0 +1,19 @@
+/* Reads the resource usage of the process and of its children,
+   then passes getrusage() a pointer into the read-only code
+   segment.  The process must be terminated with -1 exit code. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  struct rusage usage;
+
+  CHECK(getrusage(RUSAGE_SELF, &usage), "getrusage(RUSAGE_SELF)");
+  CHECK(getrusage(RUSAGE_CHILDREN, &usage), "getrusage(RUSAGE_CHILDREN)");
+  CHECK(usage.user_ticks == 0 && usage.kernel_ticks == 0, "no children have run");
+  CHECK(!getrusage(1, &usage), "getrusage(1) must fail");
+
+  getrusage(RUSAGE_SELF, (struct rusage*)test_main);
+  fail("should not have survived getrusage()");
+}
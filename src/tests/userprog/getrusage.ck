@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(getrusage) begin
+(getrusage) getrusage(RUSAGE_SELF)
+(getrusage) getrusage(RUSAGE_CHILDREN)
+(getrusage) no children have run
+(getrusage) getrusage(1) must fail
+getrusage: exit(-1)
+EOF
+pass;
@@ -0,0 +1,25 @@
+/* Reads the kernel's memory usage, then passes memstat() a
+   pointer into the read-only code segment.  The process must be
+   terminated with -1 exit code. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static struct memstat stats;
+
+void test_main(void) {
+  const struct memstat_pool* k = &stats.kernel_pool;
+  const struct memstat_pool* u = &stats.user_pool;
+
+  CHECK(memstat(&stats), "memstat");
+  CHECK(k->pages > 0 && k->used > 0 && k->used <= k->pages && k->max_used <= k->pages,
+        "kernel pool is in use");
+  CHECK(u->pages > 0 && u->used > 0 && u->used <= u->pages && u->max_used <= u->pages,
+        "user pool is in use");
+  CHECK(stats.classes[0].block_size == 16, "smallest size class is 16 bytes");
+  CHECK(stats.site_cnt <= MEMSTAT_SITE_CNT, "at most %d sites", MEMSTAT_SITE_CNT);
+
+  memstat((struct memstat*)test_main);
+  fail("should not have survived memstat()");
+}
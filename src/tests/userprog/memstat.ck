@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(memstat) begin
+(memstat) memstat
+(memstat) kernel pool is in use
+(memstat) user pool is in use
+(memstat) smallest size class is 16 bytes
+(memstat) at most 16 sites
+memstat: exit(-1)
+EOF
+pass;
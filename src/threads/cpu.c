@@ -0,0 +1,333 @@
+#include "threads/cpu.h"
+#include <debug.h>
+#include <packed.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/lapic.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/tss.h"
+#endif
+
+/* The CPUs, with the bootstrap processor first. */
+struct cpu cpus[CPU_MAX];
+
+/* Number of CPUs found. */
+int cpu_cnt;
+
+/* The CPUs, indexed by local APIC ID, for cpu_current(). */
+static struct cpu* apic_cpus[256];
+
+/* Timer ticks to wait for a CPU to come online. */
+#define START_TIMEOUT TIMER_FREQ
+
+/* MP floating pointer structure, which the BIOS leaves on a
+   16-byte boundary in low memory.  See [MPS] 4.1. */
+struct mp_floating {
+  char signature[4];   /* "_MP_". */
+  uint32_t config;     /* Physical address of struct mp_config. */
+  uint8_t length;      /* Length in 16-byte units. */
+  uint8_t spec_rev;    /* MP specification revision. */
+  uint8_t checksum;    /* Makes all the bytes sum to 0. */
+  uint8_t type;        /* Nonzero for a default configuration. */
+  uint8_t features[4]; /* Feature flags. */
+} PACKED;
+
+/* MP configuration table header, followed by ENTRY_CNT
+   variable-size entries.  See [MPS] 4.2. */
+struct mp_config {
+  char signature[4];    /* "PCMP". */
+  uint16_t length;      /* Length of header and entries. */
+  uint8_t spec_rev;     /* MP specification revision. */
+  uint8_t checksum;     /* Makes all the bytes sum to 0. */
+  char oem[8];          /* OEM ID. */
+  char product[12];     /* Product ID. */
+  uint32_t oem_table;   /* Physical address of OEM table. */
+  uint16_t oem_length;  /* Length of OEM table. */
+  uint16_t entry_cnt;   /* Number of entries. */
+  uint32_t lapic;       /* Physical address of local APICs. */
+  uint16_t ext_length;  /* Length of extended entries. */
+  uint8_t ext_checksum; /* Checksum of extended entries. */
+  uint8_t reserved;
+} PACKED;
+
+/* MP configuration table processor entry.  See [MPS] 4.3.1.
+   Every other kind of entry is 8 bytes long. */
+struct mp_processor {
+  uint8_t type;         /* MP_PROCESSOR. */
+  uint8_t apic_id;      /* Local APIC ID. */
+  uint8_t apic_version; /* Local APIC version. */
+  uint8_t flags;        /* MP_CPU_* flags. */
+  uint32_t signature;   /* CPU stepping, model, and family. */
+  uint32_t features;    /* CPUID feature flags. */
+  uint32_t reserved[2];
+} PACKED;
+
+#define MP_PROCESSOR 0     /* Processor entry type. */
+#define MP_CPU_ENABLED 0x1 /* Processor is usable. */
+#define MP_CPU_BSP 0x2     /* Processor is the bootstrap processor. */
+
+/* Startup code in ap-start.S, and the variables in it that
+   start_ap() sets. */
+extern char ap_start[], ap_start_pd[], ap_start_esp[], ap_start_end[];
+
+void cpu_ap_main(void) NO_RETURN;
+static bool start_ap(struct cpu*, uint32_t* pd);
+static intr_handler_func timer_interrupt, resched_interrupt;
+static void runqueue_init(struct runqueue*);
+static struct mp_floating* mp_search(uintptr_t, size_t);
+static struct mp_config* mp_config(void);
+static bool checksum_ok(const void*, size_t);
+
+/* Initializes the bootstrap processor's struct cpu and every
+   CPU's run queue, so that the thread system can start.  Runs
+   before anything else knows about CPUs, so until cpu_probe()
+   the bootstrap processor is the only CPU there is. */
+void cpu_init(void) {
+  int i;
+
+  for (i = 0; i < CPU_MAX; i++) {
+    cpus[i].id = i;
+    runqueue_init(&cpus[i].rq);
+  }
+  cpus[0].bsp = true;
+  cpus[0].online = true;
+  cpu_cnt = 1;
+}
+
+/* Discovers the machine's CPUs from the MP configuration table,
+   if the BIOS provided one, and maps the local APICs if there is
+   more than one.  Must run after paging_init(), with only the
+   bootstrap processor running. */
+void cpu_probe(void) {
+  struct mp_config* config = mp_config();
+  uint8_t *entry, *end;
+  int i;
+
+  if (config == NULL)
+    return;
+
+  /* The bootstrap processor keeps index 0, and the others
+     follow in table order. */
+  entry = (uint8_t*)(config + 1);
+  end = (uint8_t*)config + config->length;
+  for (i = 0; i < config->entry_cnt && entry < end; i++) {
+    if (*entry == MP_PROCESSOR) {
+      struct mp_processor* p = (struct mp_processor*)entry;
+      if (p->flags & MP_CPU_BSP)
+        cpus[0].apic_id = p->apic_id;
+      else if ((p->flags & MP_CPU_ENABLED) && cpu_cnt < CPU_MAX)
+        cpus[cpu_cnt++].apic_id = p->apic_id;
+      entry += sizeof *p;
+    } else
+      entry += 8;
+  }
+  if (cpu_cnt == 1)
+    return;
+
+  lapic_init(config->lapic);
+  for (i = 0; i < cpu_cnt; i++)
+    apic_cpus[cpus[i].apic_id] = &cpus[i];
+  printf("Found %d CPUs.\n", cpu_cnt);
+}
+
+/* Starts the CPUs other than the bootstrap processor, one at a
+   time, waiting for each to come online.  Must run on the
+   bootstrap processor with interrupts on, after
+   timer_calibrate(). */
+void cpu_start(void) {
+  uint32_t* pd;
+  int i;
+
+  ASSERT(intr_get_level() == INTR_ON);
+
+  if (cpu_cnt == 1)
+    return;
+
+  intr_register_ext(LAPIC_TIMER_VEC, timer_interrupt, "Local APIC Timer");
+  intr_register_ext(LAPIC_RESCHED_VEC, resched_interrupt, "Reschedule IPI");
+  lapic_enable();
+  lapic_timer_calibrate();
+
+  /* Tickless idle sets the 8254 to interrupt when the earliest
+     timeout is due, as of when the bootstrap processor goes idle,
+     so it would miss earlier timeouts added by other CPUs. */
+  if (timer_tickless) {
+    printf("Tickless idle needs a single CPU, so it is disabled.\n");
+    timer_tickless = false;
+  }
+
+  /* ap-start.S turns on paging while it is still running in low
+     memory, so it needs the kernel's page directory plus a
+     mapping of low memory at virtual address 0. */
+  pd = palloc_get_page(PAL_ASSERT);
+  memcpy(pd, init_page_dir, PGSIZE);
+  pd[0] = pd[pd_no(PHYS_BASE)];
+
+  for (i = 1; i < cpu_cnt; i++)
+    if (!start_ap(&cpus[i], pd)) {
+      /* It might still start later, so keep PD. */
+      printf("CPU %d did not start.\n", i);
+      return;
+    }
+  palloc_free_page(pd);
+  printf("%d CPUs online.\n", cpu_cnt);
+}
+
+/* Starts CPU C with page directory PD and waits for it to come
+   online.  Returns true if successful, false if there is no
+   memory for C's idle thread or C did not come online in
+   time. */
+static bool start_ap(struct cpu* c, uint32_t* pd) {
+  uint8_t* copy = ptov(LOADER_AP_BASE);
+  struct thread* idle = thread_create_idle(c);
+  int64_t start;
+
+  if (idle == NULL)
+    return false;
+
+  memcpy(copy, ap_start, ap_start_end - ap_start);
+  *(uint32_t*)(copy + (ap_start_pd - ap_start)) = vtop(pd);
+  *(void**)(copy + (ap_start_esp - ap_start)) = (uint8_t*)idle + PGSIZE;
+
+  /* See [IA32-v3a] 8.4.4.1 "Typical BSP Initialization
+     Sequence". */
+  lapic_send_init(c->apic_id);
+  timer_msleep(10);
+  lapic_send_startup(c->apic_id, LOADER_AP_BASE);
+  timer_usleep(200);
+  lapic_send_startup(c->apic_id, LOADER_AP_BASE);
+
+  start = timer_ticks();
+  while (!c->online && timer_elapsed(start) < START_TIMEOUT)
+    barrier();
+  return c->online;
+}
+
+/* Entered from ap-start.S by each CPU other than the bootstrap
+   processor, with interrupts off, on the stack of the idle thread
+   that start_ap() created for it.  Finishes setting up the CPU,
+   then becomes its idle thread. */
+void cpu_ap_main(void) {
+  /* Leave ap-start.S's page directory for the kernel's. */
+  asm volatile("movl %0, %%cr3" : : "r"(vtop(init_page_dir)) : "memory");
+  intr_init_ap();
+  thread_init_ap();
+
+#ifdef USERPROG
+  tss_init();
+  gdt_init();
+#endif
+
+  lapic_enable();
+  lapic_timer_start();
+  cpu_current()->online = true;
+  thread_start_ap();
+}
+
+/* Returns the CPU that is running this code.  Unless interrupts
+   are off, the running thread may move to another CPU at any
+   time, so that the answer is out of date by the time it is
+   used. */
+struct cpu* cpu_current(void) { return lapic_present() ? apic_cpus[lapic_id()] : &cpus[0]; }
+
+/* Interrupts CPU C, which must not be the running CPU, so that it
+   reconsiders which thread to run after a thread becomes ready
+   on its run queue.  If C is idle, it would otherwise notice the
+   thread only at its next timer tick. */
+void cpu_kick(struct cpu* c) {
+  ASSERT(c != cpu_current());
+
+  if (c->online)
+    lapic_send_ipi(c->apic_id, LAPIC_RESCHED_VEC);
+}
+
+/* Prints per-CPU scheduling statistics. */
+void cpu_print_stats(void) {
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    if (cpus[i].online)
+      printf("CPU %d: %llu switches, %llu steals\n", i, cpus[i].switches, cpus[i].steals);
+}
+
+/* Local APIC timer interrupt handler.  Only CPUs other than the
+   bootstrap processor, whose ticks come from the 8254 (see
+   devices/timer.c), run their local APIC timers. */
+static void timer_interrupt(struct intr_frame* args) {
+  thread_tick((args->cs & 3) == 3); /* Interrupted privilege level 3? */
+}
+
+/* Handler for the interrupt that cpu_kick() sends. */
+static void resched_interrupt(struct intr_frame* args UNUSED) { check_thread_yield(); }
+
+/* Initializes RQ as empty. */
+static void runqueue_init(struct runqueue* rq) {
+  int i;
+
+  spinlock_init(&rq->lock, "runqueue");
+  for (i = 0; i <= PRI_MAX; i++)
+    list_init(&rq->queues[i]);
+  rq->mask = 0;
+  rq->cnt = 0;
+}
+
+/* Returns the MP configuration table, or a null pointer if there
+   is none or it is malformed. */
+static struct mp_config* mp_config(void) {
+  uintptr_t ram_end = init_ram_pages * PGSIZE;
+  uint16_t ebda_seg = *(uint16_t*)ptov(0x40e);
+  uint16_t base_kb = *(uint16_t*)ptov(0x413);
+  struct mp_floating* mpf;
+  struct mp_config* config;
+
+  /* The floating pointer is in the first kilobyte of the
+     extended BIOS data area, in the last kilobyte of base memory,
+     or in the BIOS ROM.  See [MPS] 4. */
+  mpf = mp_search((uintptr_t)ebda_seg << 4, 1024);
+  if (mpf == NULL)
+    mpf = mp_search((uintptr_t)base_kb * 1024 - 1024, 1024);
+  if (mpf == NULL)
+    mpf = mp_search(0xf0000, 0x10000);
+  if (mpf == NULL || mpf->config == 0 || mpf->config + sizeof *config > ram_end)
+    return NULL;
+
+  config = ptov(mpf->config);
+  if (memcmp(config->signature, "PCMP", 4) || mpf->config + config->length > ram_end
+      || !checksum_ok(config, config->length))
+    return NULL;
+  return config;
+}
+
+/* Searches the LENGTH bytes of physical memory starting at
+   START for the MP floating pointer structure.  Returns the
+   structure if found, otherwise a null pointer. */
+static struct mp_floating* mp_search(uintptr_t start, size_t length) {
+  uintptr_t p;
+
+  if (start < 1024)
+    return NULL;
+  for (p = start; p + sizeof(struct mp_floating) <= start + length; p += 16) {
+    struct mp_floating* mpf = ptov(p);
+    if (!memcmp(mpf->signature, "_MP_", 4) && checksum_ok(mpf, sizeof *mpf))
+      return mpf;
+  }
+  return NULL;
+}
+
+/* Returns true if the SIZE bytes at BLOCK sum to zero. */
+static bool checksum_ok(const void* block, size_t size) {
+  const uint8_t* p = block;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *p++;
+  return sum == 0;
+}
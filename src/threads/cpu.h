@@ -0,0 +1,76 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Processors.
+
+   Each CPU has its own struct cpu, holding the data that only
+   that CPU touches on its fast paths, most importantly its run
+   queue.  A thread becomes ready on the run queue of the CPU it
+   last ran on, and a CPU whose run queue is empty steals the
+   highest-priority ready thread from the busiest other CPU.
+
+   CPUs are discovered from the MultiProcessor Specification
+   tables that the BIOS leaves in low memory.  Once the scheduler
+   is running on the bootstrap processor, cpu_start() starts each
+   of the others, which becomes an idle thread that runs whatever
+   threads it can take from the other CPUs' run queues.  Each CPU
+   has its own idle thread, local APIC timer, and TSS, and
+   cpu_current() tells the CPUs apart by their local APIC IDs.
+
+   Kernel code protects most shared data by turning interrupts
+   off, which keeps out only the running CPU's other threads, so
+   turning interrupts off also takes a lock shared by all CPUs
+   (see interrupt.c).  Only one CPU at a time runs with interrupts
+   off, and the others keep running user programs and kernel code
+   that has interrupts on. */
+
+/* Maximum number of CPUs. */
+#define CPU_MAX 16
+
+/* Threads that are ready to run on one CPU.  There is one FIFO
+   queue per priority, indexed by effective priority, and bit P
+   of MASK is set if and only if QUEUES[P] is nonempty, so that
+   the highest-priority ready thread can be found in constant
+   time. */
+struct runqueue {
+  struct spinlock lock;            /* Protects the members below. */
+  struct list queues[PRI_MAX + 1]; /* Ready threads, by priority. */
+  uint64_t mask;                   /* Nonempty queues. */
+  int cnt;                         /* Number of ready threads. */
+};
+
+/* A CPU. */
+struct cpu {
+  int id;                /* Index in cpus[]. */
+  uint8_t apic_id;       /* Local APIC ID. */
+  bool bsp;              /* Bootstrap processor? */
+  bool online;           /* Running threads? */
+  struct runqueue rq;    /* Threads ready to run here. */
+  struct thread* idle;   /* Idle thread. */
+  int64_t ticks;         /* Timer ticks on this CPU. */
+  unsigned slice_ticks;  /* Timer ticks since the running thread's last yield. */
+  bool in_external_intr; /* Processing an external interrupt? */
+  bool yield_on_return;  /* Yield when the external interrupt returns? */
+
+  /* Statistics. */
+  uint64_t switches; /* Thread switches. */
+  uint64_t steals;   /* Threads taken from other CPUs' run queues. */
+};
+
+extern struct cpu cpus[CPU_MAX];
+extern int cpu_cnt;
+
+void cpu_init(void);
+void cpu_probe(void);
+void cpu_start(void);
+struct cpu* cpu_current(void);
+void cpu_kick(struct cpu*);
+void cpu_print_stats(void);
+
+#endif /* threads/cpu.h */
@@ -15,13 +15,16 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -34,9 +37,15 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t* init_page_dir;
@@ -49,9 +58,13 @@ static bool format_filesys;
    overriding the defaults. */
 static const char* filesys_bdev_name;
 static const char* scratch_bdev_name;
+
 #ifdef VM
 static const char* swap_bdev_name;
 #endif
+
+/* -ramdisk: Size of RAM disk to create, in kB, or 0 for none. */
+static size_t ramdisk_kb;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
@@ -95,6 +108,7 @@ int main(void) {
   palloc_init(user_page_limit);
   malloc_init();
   paging_init();
+  cpu_probe();
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -114,16 +128,26 @@ int main(void) {
 
   /* Start thread scheduler and enable interrupts. */
   thread_start();
+  workqueue_init();
   serial_init_queue();
   timer_calibrate();
+  cpu_start();
 
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init();
+  if (ramdisk_kb > 0)
+    ramdisk_init(ramdisk_kb);
   locate_block_devices();
   filesys_init(format_filesys);
 #endif
 
+#ifdef VM
+  /* Initialize virtual memory. */
+  frame_init();
+  swap_init();
+#endif
+
   printf("Boot complete.\n");
 
   /* Run actions specified on kernel command line. */
@@ -232,15 +256,37 @@ static char** parse_options(char** argv) {
       filesys_bdev_name = value;
     else if (!strcmp(name, "-scratch"))
       scratch_bdev_name = value;
+    else if (!strcmp(name, "-ramdisk"))
+      ramdisk_kb = atoi(value);
 #ifdef VM
     else if (!strcmp(name, "-swap"))
       swap_bdev_name = value;
+    else if (!strcmp(name, "-stack")) {
+      page_stack_max = atoi(value);
+      if (page_stack_max == 0)
+        PANIC("stack limit must be at least one page");
+    }
 #endif
 #endif
     else if (!strcmp(name, "-rs"))
       random_init(atoi(value));
     else if (!strcmp(name, "-mlfqs"))
       thread_mlfqs = true;
+    else if (!strcmp(name, "-slice")) {
+      int ticks = atoi(value);
+      if (ticks < 1 || (unsigned)ticks > SLICE_MAX)
+        PANIC("time slice must be between 1 and %u ticks", SLICE_MAX);
+      thread_time_slice = ticks;
+    } else if (!strcmp(name, "-slice-scale"))
+      thread_slice_scaled = true;
+    else if (!strcmp(name, "-lockprof"))
+      lock_profiling = true;
+    else if (!strcmp(name, "-schedtrace"))
+      thread_trace = true;
+    else if (!strcmp(name, "-tickless"))
+      timer_tickless = true;
+    else if (!strcmp(name, "-memtag"))
+      malloc_tagging = true;
 #ifdef USERPROG
     else if (!strcmp(name, "-ul"))
       user_page_limit = atoi(value);
@@ -348,12 +394,20 @@ static void usage(void) {
          "  -f                 Format file system device during startup.\n"
          "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
          "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+         "  -ramdisk=KB        Create a KB-kilobyte RAM disk named ram0.\n"
 #ifdef VM
          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+         "  -stack=PAGES       Let user stacks grow to PAGES pages (default 2048).\n"
 #endif
 #endif
          "  -rs=SEED           Set random number seed to SEED.\n"
          "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+         "  -slice=TICKS       Give each thread a time slice of TICKS ticks.\n"
+         "  -slice-scale       Lengthen time slices at low priorities, shorten at high.\n"
+         "  -lockprof          Measure lock contention and report it at shutdown.\n"
+         "  -schedtrace        Record scheduler events and print them at shutdown.\n"
+         "  -tickless          Skip timer ticks while idle.\n"
+         "  -memtag            Tag malloc() blocks by caller and report those not freed.\n"
 #ifdef USERPROG
          "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
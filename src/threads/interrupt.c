@@ -3,9 +3,12 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/lapic.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
@@ -38,14 +41,31 @@ static const char* intr_names[INTR_CNT];
 static unsigned int unexpected_cnt[INTR_CNT];
 
 /* External interrupts are those generated by devices outside the
-   CPU, such as the timer.  External interrupts run with
-   interrupts turned off, so they never nest, nor are they ever
-   pre-empted.  Handlers for external interrupts also may not
-   sleep, although they may invoke intr_yield_on_return() to
-   request that a new process be scheduled just before the
-   interrupt returns. */
-static bool in_external_intr; /* Are we processing an external interrupt? */
-static bool yield_on_return;  /* Should we yield on interrupt return? */
+   CPU, such as the timer, which come through the PICs, and those
+   that come through the local APIC (see lapic.h).  External
+   interrupts run with interrupts turned off, so they never nest,
+   nor are they ever pre-empted.  Handlers for external interrupts
+   also may not sleep, although they may invoke
+   intr_yield_on_return() to request that a new process be
+   scheduled just before the interrupt returns.  Each CPU keeps
+   track of its own external interrupt, in its struct cpu. */
+
+/* Interrupt lock.
+
+   Much of the kernel protects data shared between threads by
+   turning interrupts off, which on its own keeps out only the
+   other threads of the same CPU.  So that turning interrupts off
+   keeps out every other CPU as well, a CPU holds this lock
+   exactly when it has interrupts off: intr_disable() acquires it
+   and intr_enable() releases it, and an interrupt handler
+   entered through an interrupt gate acquires it on entry and
+   releases it on return.  Threads switch with interrupts off, so
+   a thread that sleeps with interrupts off leaves the lock to
+   the next thread on its CPU.
+
+   Each CPU starts out with interrupts off but without the lock,
+   and takes it in intr_init() or intr_init_ap(). */
+static struct spinlock intr_lock;
 
 /* Programmable Interrupt Controller helpers. */
 static void pic_init(void);
@@ -57,6 +77,7 @@ static uint64_t make_trap_gate(void (*)(void), int dpl);
 static inline uint64_t make_idtr_operand(uint16_t limit, void* base);
 
 /* Interrupt handlers. */
+static bool is_external(uint8_t vec_no);
 void intr_handler(struct intr_frame* args);
 static void unexpected_interrupt(const struct intr_frame*);
 
@@ -84,6 +105,9 @@ enum intr_level intr_enable(void) {
   enum intr_level old_level = intr_get_level();
   ASSERT(!intr_context());
 
+  if (old_level == INTR_OFF)
+    spin_unlock(&intr_lock);
+
   /* Enable interrupts by setting the interrupt flag.
 
      See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
@@ -102,14 +126,40 @@ enum intr_level intr_disable(void) {
      Hardware Interrupts". */
   asm volatile("cli" : : : "memory");
 
+  if (old_level == INTR_ON)
+    spin_lock(&intr_lock);
+
   return old_level;
 }
 
+/* Enables interrupts and halts the CPU until an interrupt
+   arrives.  Interrupts must be off. */
+void intr_wait(void) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(!intr_context());
+
+  spin_unlock(&intr_lock);
+
+  /* The `sti' instruction disables interrupts until the
+     completion of the next instruction, so these two
+     instructions are executed atomically.  This atomicity is
+     important; otherwise, an interrupt could be handled between
+     re-enabling interrupts and waiting for the next one to occur,
+     wasting as much as one clock tick worth of time.
+     See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
+     7.11.1 "HLT Instruction". */
+  asm volatile("sti; hlt" : : : "memory");
+}
+
 /* Initializes the interrupt system. */
 void intr_init(void) {
   uint64_t idtr_operand;
   int i;
 
+  /* The bootstrap processor has had interrupts off all along. */
+  spinlock_init(&intr_lock, "interrupts");
+  spin_lock(&intr_lock);
+
   /* Initialize interrupt controller. */
   pic_init();
 
@@ -147,6 +197,18 @@ void intr_init(void) {
   intr_names[19] = "#XF SIMD Floating-Point Exception";
 }
 
+/* Loads the IDT that intr_init() set up into a CPU other than
+   the bootstrap processor, which must have interrupts off. */
+void intr_init_ap(void) {
+  uint64_t idtr_operand;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  spin_lock(&intr_lock);
+
+  idtr_operand = make_idtr_operand(sizeof idt - 1, idt);
+  asm volatile("lidt %0" : : "m"(idtr_operand));
+}
+
 /* Registers interrupt VEC_NO to invoke HANDLER with descriptor
    privilege level DPL.  Names the interrupt NAME for debugging
    purposes.  The interrupt handler will be invoked with
@@ -166,7 +228,7 @@ static void register_handler(uint8_t vec_no, int dpl, enum intr_level level,
    is named NAME for debugging purposes.  The handler will
    execute with interrupts disabled. */
 void intr_register_ext(uint8_t vec_no, intr_handler_func* handler, const char* name) {
-  ASSERT(vec_no >= 0x20 && vec_no <= 0x2f);
+  ASSERT(is_external(vec_no));
   register_handler(vec_no, 0, INTR_OFF, handler, name);
 }
 
@@ -185,13 +247,17 @@ void intr_register_ext(uint8_t vec_no, intr_handler_func* handler, const char* n
    discussion. */
 void intr_register_int(uint8_t vec_no, int dpl, enum intr_level level, intr_handler_func* handler,
                        const char* name) {
-  ASSERT(vec_no < 0x20 || vec_no > 0x2f);
+  ASSERT(!is_external(vec_no));
   register_handler(vec_no, dpl, level, handler, name);
 }
 
 /* Returns true during processing of an external interrupt
    and false at all other times. */
-bool intr_context(void) { return in_external_intr; }
+bool intr_context(void) {
+  /* With interrupts on, the running thread may move to another
+     CPU, but then it cannot be in an external interrupt. */
+  return intr_get_level() == INTR_OFF && cpu_current()->in_external_intr;
+}
 
 /* During processing of an external interrupt, directs the
    interrupt handler to yield to a new process just before
@@ -199,7 +265,7 @@ bool intr_context(void) { return in_external_intr; }
    time. */
 void intr_yield_on_return(void) {
   ASSERT(intr_context());
-  yield_on_return = true;
+  cpu_current()->yield_on_return = true;
 }
 
 /* 8259A Programmable Interrupt Controller. */
@@ -307,27 +373,37 @@ static inline uint64_t make_idtr_operand(uint16_t limit, void* base) {
    intr-stubs.S.  FRAME describes the interrupt and the
    interrupted thread's registers. */
 void intr_handler(struct intr_frame* frame) {
+  struct cpu* c;
   bool external;
   intr_handler_func* handler;
 
+  /* If an interrupt gate turned interrupts off, take the
+     interrupt lock, as intr_disable() would have. */
+  if (intr_get_level() == INTR_OFF && (frame->eflags & FLAG_IF))
+    spin_lock(&intr_lock);
+
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
-     and they need to be acknowledged on the PIC (see below).
+     and they need to be acknowledged on the PIC or the local
+     APIC (see below).
      An external interrupt handler cannot sleep. */
-  external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+  external = is_external(frame->vec_no);
   if (external) {
     ASSERT(intr_get_level() == INTR_OFF);
     ASSERT(!intr_context());
 
-    in_external_intr = true;
-    yield_on_return = false;
+    c = cpu_current();
+    c->in_external_intr = true;
+    c->yield_on_return = false;
+    if (frame->vec_no < 0x30)
+      timer_irq_enter();
   }
 
   /* Invoke the interrupt's handler. */
   handler = intr_handlers[frame->vec_no];
   if (handler != NULL)
     handler(frame);
-  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f) {
+  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f || frame->vec_no == LAPIC_SPURIOUS_VEC) {
     /* There is no handler, but this interrupt can trigger
          spuriously due to a hardware fault or hardware race
          condition.  Ignore it. */
@@ -339,12 +415,29 @@ void intr_handler(struct intr_frame* frame) {
     ASSERT(intr_get_level() == INTR_OFF);
     ASSERT(intr_context());
 
-    in_external_intr = false;
-    pic_end_of_interrupt(frame->vec_no);
+    c->in_external_intr = false;
+    if (frame->vec_no < 0x30)
+      pic_end_of_interrupt(frame->vec_no);
+    else if (frame->vec_no != LAPIC_SPURIOUS_VEC)
+      lapic_eoi();
 
-    if (yield_on_return)
+    if (c->yield_on_return)
       thread_yield();
   }
+
+  /* Return holding the interrupt lock if and only if the
+     interrupted code had interrupts off.  Returning to code that
+     had them on turns them on again. */
+  if (!(frame->eflags & FLAG_IF))
+    intr_disable();
+  else if (intr_get_level() == INTR_OFF)
+    spin_unlock(&intr_lock);
+}
+
+/* Returns true if VEC_NO is an external interrupt, from the PICs
+   or the local APIC. */
+static bool is_external(uint8_t vec_no) {
+  return (vec_no >= 0x20 && vec_no <= 0x2f) || vec_no >= LAPIC_VEC_MIN;
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
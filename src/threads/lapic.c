@@ -0,0 +1,159 @@
+#include "threads/lapic.h"
+#include <debug.h>
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+/* Kernel virtual address at which the registers are mapped: the
+   last page of the address space, far above the mapping of RAM
+   at PHYS_BASE. */
+#define LAPIC_VADDR 0xfffff000
+
+/* Register offsets.  See [IA32-v3a] table 10-1 "Local APIC
+   Register Address Map". */
+#define LAPIC_ID 0x020         /* Local APIC ID. */
+#define LAPIC_TPR 0x080        /* Task priority. */
+#define LAPIC_EOI 0x0b0        /* End of interrupt. */
+#define LAPIC_SVR 0x0f0        /* Spurious interrupt vector. */
+#define LAPIC_ICR_LOW 0x300    /* Interrupt command, bits 0...31. */
+#define LAPIC_ICR_HIGH 0x310   /* Interrupt command, bits 32...63. */
+#define LAPIC_LVT_TIMER 0x320  /* Local vector table: timer. */
+#define LAPIC_TIMER_INIT 0x380 /* Timer initial count. */
+#define LAPIC_TIMER_CUR 0x390  /* Timer current count. */
+#define LAPIC_TIMER_DIV 0x3e0  /* Timer divide configuration. */
+
+#define SVR_ENABLE 0x100 /* APIC software enable. */
+
+/* Interrupt command register bits. */
+#define ICR_FIXED 0x000    /* Deliver the vector in bits 0...7. */
+#define ICR_INIT 0x500     /* INIT: reset the target. */
+#define ICR_STARTUP 0x600  /* Start-up: run real-mode code at vector * 4 kB. */
+#define ICR_PENDING 0x1000 /* Delivery not yet accepted. */
+#define ICR_ASSERT 0x4000  /* Level: assert. */
+#define ICR_LEVEL 0x8000   /* Trigger mode: level. */
+
+/* Local vector table bits. */
+#define LVT_MASKED 0x10000   /* Interrupt masked. */
+#define LVT_PERIODIC 0x20000 /* Timer: periodic, not one-shot. */
+
+#define TIMER_DIV_16 0x3 /* Timer counts at bus frequency / 16. */
+
+/* Timer ticks to measure the local APIC timer against. */
+#define CALIBRATE_TICKS 10
+
+static volatile uint32_t* lapic; /* Registers, or null if not mapped. */
+static uint32_t count_per_tick;  /* Timer counts per timer tick. */
+
+static uint32_t lapic_read(unsigned reg) { return lapic[reg / sizeof *lapic]; }
+static void lapic_write(unsigned reg, uint32_t value) { lapic[reg / sizeof *lapic] = value; }
+static void send_ipi(uint8_t apic_id, uint32_t icr);
+
+/* Maps the local APIC registers, found at physical address PHYS,
+   into the kernel's address space.  Each CPU sees its own local
+   APIC at the same address, so one mapping serves them all.
+   Must be called before any process's page directory is
+   created, since those copy the kernel's mappings. */
+void lapic_init(uintptr_t phys) {
+  uint32_t* pt = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+
+  ASSERT(init_page_dir[pd_no((void*)LAPIC_VADDR)] == 0);
+
+  /* The registers must not be cached. */
+  init_page_dir[pd_no((void*)LAPIC_VADDR)] = pde_create(pt) & ~PTE_U;
+  pt[pt_no((void*)LAPIC_VADDR)] = (phys & PTE_ADDR) | PTE_PCD | PTE_PWT | PTE_W | PTE_P;
+  lapic = (volatile uint32_t*)LAPIC_VADDR;
+}
+
+/* Returns true if lapic_init() has mapped the local APIC. */
+bool lapic_present(void) { return lapic != NULL; }
+
+/* Enables the running CPU's local APIC to accept interrupts of
+   every priority. */
+void lapic_enable(void) {
+  lapic_write(LAPIC_TPR, 0);
+  lapic_write(LAPIC_SVR, SVR_ENABLE | LAPIC_SPURIOUS_VEC);
+}
+
+/* Returns the running CPU's local APIC ID. */
+uint8_t lapic_id(void) { return lapic_read(LAPIC_ID) >> 24; }
+
+/* Signals the end of the interrupt being handled. */
+void lapic_eoi(void) { lapic_write(LAPIC_EOI, 0); }
+
+/* Resets the CPU with the given APIC_ID, which then waits for a
+   start-up IPI.  See [IA32-v3a] 8.4.4 "MP Initialization
+   Example". */
+void lapic_send_init(uint8_t apic_id) {
+  send_ipi(apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+  send_ipi(apic_id, ICR_INIT | ICR_LEVEL);
+}
+
+/* Starts the CPU with the given APIC_ID, which must be waiting
+   after lapic_send_init(), running real-mode code at physical
+   address PHYS, which must be page-aligned and below 1 MB. */
+void lapic_send_startup(uint8_t apic_id, uintptr_t phys) {
+  ASSERT(phys % PGSIZE == 0 && phys < 0x100000);
+  send_ipi(apic_id, ICR_STARTUP | (phys / PGSIZE));
+}
+
+/* Sends interrupt VEC to the CPU with the given APIC_ID. */
+void lapic_send_ipi(uint8_t apic_id, uint8_t vec) { send_ipi(apic_id, ICR_FIXED | vec); }
+
+/* Measures the rate of the local APIC timers against the 8254
+   timer.  Every CPU's timer runs at the bus clock, so measuring
+   the running CPU's serves for all of them.  Interrupts must be
+   on, so that the timer ticks. */
+void lapic_timer_calibrate(void) {
+  int64_t start;
+
+  ASSERT(intr_get_level() == INTR_ON);
+
+  lapic_write(LAPIC_TIMER_DIV, TIMER_DIV_16);
+  lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | LAPIC_TIMER_VEC);
+
+  /* Count down from the top for CALIBRATE_TICKS whole ticks. */
+  start = timer_ticks();
+  while (timer_ticks() == start)
+    barrier();
+  start = timer_ticks();
+  lapic_write(LAPIC_TIMER_INIT, UINT32_MAX);
+  while (timer_elapsed(start) < CALIBRATE_TICKS)
+    barrier();
+  count_per_tick = (UINT32_MAX - lapic_read(LAPIC_TIMER_CUR)) / CALIBRATE_TICKS;
+  lapic_write(LAPIC_TIMER_INIT, 0);
+
+  if (count_per_tick == 0)
+    count_per_tick = 1;
+}
+
+/* Makes the running CPU's local APIC timer interrupt
+   TIMER_FREQ times per second. */
+void lapic_timer_start(void) {
+  ASSERT(count_per_tick > 0);
+
+  lapic_write(LAPIC_TIMER_DIV, TIMER_DIV_16);
+  lapic_write(LAPIC_LVT_TIMER, LVT_PERIODIC | LAPIC_TIMER_VEC);
+  lapic_write(LAPIC_TIMER_INIT, count_per_tick);
+}
+
+/* Sends an interprocessor interrupt with interrupt command ICR
+   to the CPU with the given APIC_ID, and waits for its local
+   APIC to accept it. */
+static void send_ipi(uint8_t apic_id, uint32_t icr) {
+  enum intr_level old_level;
+
+  ASSERT(lapic != NULL);
+
+  /* The command takes two writes, which an interrupt handler
+     sending its own IPI must not come between. */
+  old_level = intr_disable();
+  lapic_write(LAPIC_ICR_HIGH, (uint32_t)apic_id << 24);
+  lapic_write(LAPIC_ICR_LOW, icr);
+  while (lapic_read(LAPIC_ICR_LOW) & ICR_PENDING)
+    asm volatile("pause" : : : "memory");
+  intr_set_level(old_level);
+}
@@ -0,0 +1,38 @@
+#ifndef THREADS_LAPIC_H
+#define THREADS_LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Local APIC.
+
+   Each CPU has a local APIC, which delivers the CPU's interrupts
+   and through which it sends interrupts to other CPUs.  Devices
+   still interrupt only the bootstrap processor, through the
+   8259A PICs (see interrupt.c), which the BIOS connects to the
+   bootstrap processor's local APIC in "virtual wire" mode.  The
+   local APICs carry each CPU's own timer and the interrupts that
+   CPUs send each other.
+
+   See [IA32-v3a] chapter 10 "Advanced Programmable Interrupt
+   Controller (APIC)". */
+
+/* Interrupt vectors.  Vectors LAPIC_VEC_MIN and up are external
+   interrupts, like the PICs' 0x20...0x2f. */
+#define LAPIC_VEC_MIN 0xf0
+#define LAPIC_TIMER_VEC 0xf0    /* Local timer tick. */
+#define LAPIC_RESCHED_VEC 0xf1  /* Reschedule request from another CPU. */
+#define LAPIC_SPURIOUS_VEC 0xff /* Spurious interrupt. */
+
+void lapic_init(uintptr_t phys);
+bool lapic_present(void);
+void lapic_enable(void);
+uint8_t lapic_id(void);
+void lapic_eoi(void);
+void lapic_send_init(uint8_t apic_id);
+void lapic_send_startup(uint8_t apic_id, uintptr_t phys);
+void lapic_send_ipi(uint8_t apic_id, uint8_t vec);
+void lapic_timer_calibrate(void);
+void lapic_timer_start(void);
+
+#endif /* threads/lapic.h */
@@ -5,6 +5,11 @@
 #define LOADER_BASE 0x7c00 /* Physical address of loader's base. */
 #define LOADER_END 0x7e00  /* Physical address of end of loader. */
 
+/* Physical address to which the kernel copies ap-start.S for
+   the other CPUs to start at.  Must be page-aligned and below
+   1 MB.  Nothing uses the memory below the loader after boot. */
+#define LOADER_AP_BASE 0x7000
+
 /* Physical address of kernel base. */
 #define LOADER_KERN_BASE 0x20000 /* 128 kB. */
 
@@ -1,12 +1,15 @@
 #include "threads/malloc.h"
 #include <debug.h>
+#include <inttypes.h>
 #include <list.h>
 #include <round.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -28,11 +31,28 @@
    blocks, we remove all of the arena's blocks from the free list
    and give the arena back to the page allocator.
 
+   Taking the descriptor's lock on every call would be costly, so
+   each thread also keeps a "magazine" of free blocks of each
+   size, which only it touches and so needs no lock.  malloc()
+   takes a block from the running thread's magazine, first
+   refilling it from the free list with a batch of blocks if it
+   is empty.  free() puts the block in the running thread's
+   magazine, first returning a batch of blocks to the free list
+   if it is full.  A block in a magazine is still allocated, as
+   far as its arena is concerned.  A thread's magazines are
+   emptied when it exits.
+
    We can't handle blocks bigger than 2 kB using this scheme,
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   With allocation-site tagging, enabled by kernel command-line
+   option "-memtag", every block not yet freed is also recorded in
+   a hash table along with its size and the return address of the
+   malloc(), calloc(), or realloc() call that allocated it, so that
+   leaks can be traced to their source. */
 
 /* Descriptor. */
 struct desc {
@@ -40,6 +60,13 @@ struct desc {
   size_t blocks_per_arena; /* Number of blocks in an arena. */
   struct list free_list;   /* List of free blocks. */
   struct lock lock;        /* Lock. */
+
+  /* Statistics.  Blocks allocated and freed through a magazine
+     are added in when the magazine is refilled or drained. */
+  size_t arenas;     /* Arenas allocated. */
+  size_t max_arenas; /* Most arenas allocated at once. */
+  uint64_t allocs;   /* Blocks allocated. */
+  uint64_t frees;    /* Blocks freed. */
 };
 
 /* Magic number for detecting arena corruption. */
@@ -55,14 +82,57 @@ struct arena {
 /* Free block. */
 struct block {
   struct list_elem free_elem; /* Free list element. */
+  struct block* next;         /* Next block in a magazine. */
 };
 
+/* Number of blocks a magazine holds when full.  An empty
+   magazine is refilled, and a full one drained, to half this. */
+#define MAGAZINE_SIZE 8
+
 /* Our set of descriptors. */
-static struct desc descs[10]; /* Descriptors. */
-static size_t desc_cnt;       /* Number of descriptors. */
+static struct desc descs[MALLOC_DESC_CNT]; /* Descriptors. */
+static size_t desc_cnt;                    /* Number of descriptors. */
+
+/* Big blocks.  Updated with interrupts off. */
+static uint64_t big_allocs; /* Big blocks allocated. */
+static uint64_t big_frees;  /* Big blocks freed. */
+static size_t big_pages;    /* Pages in big blocks not yet freed. */
+
+/* If false (default), allocation sites are not recorded.
+   If true, set by kernel command-line option "-memtag", the site
+   of each block not yet freed is kept in the tag table. */
+bool malloc_tagging;
+
+/* Tag table, an open-addressing hash table with linear probing,
+   keyed on block address.  It is never allowed to become more
+   than 3/4 full, so that probes stay short; blocks that do not
+   fit are counted in TAG_DROPPED instead. */
+#define TAG_SLOTS 8192
+struct tag {
+  void* block;  /* Block, or null if the slot is empty. */
+  void* caller; /* Return address of the allocating call. */
+  size_t size;  /* Bytes requested. */
+};
+static struct tag* tags;          /* TAG_SLOTS slots. */
+static size_t tag_cnt;            /* Slots in use. */
+static uint32_t tag_dropped;      /* Blocks not recorded. */
+static struct spinlock tag_lock;  /* Protects the tag table. */
+
+/* Scratch table for tag_sites() to total the tagged blocks by
+   caller, TAG_SLOTS sites keyed on caller like the tag table, so
+   that every caller fits.  Protected by tag_lock. */
+static struct memstat_site* site_table;
 
 static struct arena* block_to_arena(struct block*);
 static struct block* arena_to_block(struct arena*, size_t idx);
+static void* alloc_block(size_t);
+static void free_block(void*);
+static bool magazine_refill(struct desc*, struct magazine*);
+static void magazine_drain(struct desc*, struct magazine*, unsigned keep);
+static void magazine_flush(struct desc*, struct magazine*);
+static void* tag_insert(void* block, size_t size, void* caller);
+static void tag_remove(void* block);
+static uint32_t tag_sites(struct memstat_site*, uint32_t max);
 
 /* Initializes the malloc() descriptors. */
 void malloc_init(void) {
@@ -76,12 +146,28 @@ void malloc_init(void) {
     list_init(&d->free_list);
     lock_init(&d->lock);
   }
+  ASSERT(desc_cnt == MALLOC_DESC_CNT);
+  ASSERT(desc_cnt == MEMSTAT_CLASS_CNT);
+
+  spinlock_init(&tag_lock, "tags");
+  if (malloc_tagging) {
+    tags = palloc_get_multiple(PAL_ASSERT | PAL_ZERO,
+                               DIV_ROUND_UP(TAG_SLOTS * sizeof *tags, PGSIZE));
+    site_table =
+        palloc_get_multiple(PAL_ASSERT, DIV_ROUND_UP(TAG_SLOTS * sizeof *site_table, PGSIZE));
+  }
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
    Returns a null pointer if memory is not available. */
 void* malloc(size_t size) {
+  return tag_insert(alloc_block(size), size, __builtin_return_address(0));
+}
+
+/* Does the work of malloc(), without tagging. */
+static void* alloc_block(size_t size) {
   struct desc* d;
+  struct magazine* m;
   struct block* b;
   struct arena* a;
 
@@ -107,37 +193,25 @@ void* malloc(size_t size) {
     a->magic = ARENA_MAGIC;
     a->desc = NULL;
     a->free_cnt = page_cnt;
-    return a + 1;
-  }
 
-  lock_acquire(&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty(&d->free_list)) {
-    size_t i;
-
-    /* Allocate a page. */
-    a = palloc_get_page(0);
-    if (a == NULL) {
-      lock_release(&d->lock);
-      return NULL;
-    }
-
-    /* Initialize arena and add its blocks to the free list. */
-    a->magic = ARENA_MAGIC;
-    a->desc = d;
-    a->free_cnt = d->blocks_per_arena;
-    for (i = 0; i < d->blocks_per_arena; i++) {
-      struct block* b = arena_to_block(a, i);
-      list_push_back(&d->free_list, &b->free_elem);
-    }
+    enum intr_level old_level = intr_disable();
+    big_allocs++;
+    big_pages += page_cnt;
+    intr_set_level(old_level);
+    return a + 1;
   }
 
-  /* Get a block from free list and return it. */
-  b = list_entry(list_pop_front(&d->free_list), struct block, free_elem);
-  a = block_to_arena(b);
-  a->free_cnt--;
-  lock_release(&d->lock);
+  /* Take a block from our magazine, refilling it if it is
+     empty.  An interrupt handler must not touch the magazines of
+     the thread it interrupted. */
+  ASSERT(!intr_context());
+  m = &thread_current()->magazines[d - descs];
+  if (m->cnt == 0 && !magazine_refill(d, m))
+    return NULL;
+  b = m->top;
+  m->top = b->next;
+  m->cnt--;
+  m->allocs++;
   return b;
 }
 
@@ -153,7 +227,7 @@ void* calloc(size_t a, size_t b) {
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc(size);
+  p = tag_insert(alloc_block(size), size, __builtin_return_address(0));
   if (p != NULL)
     memset(p, 0, size);
 
@@ -180,7 +254,7 @@ void* realloc(void* old_block, size_t new_size) {
     free(old_block);
     return NULL;
   } else {
-    void* new_block = malloc(new_size);
+    void* new_block = tag_insert(alloc_block(new_size), new_size, __builtin_return_address(0));
     if (old_block != NULL && new_block != NULL) {
       size_t old_size = block_size(old_block);
       size_t min_size = new_size < old_size ? new_size : old_size;
@@ -195,42 +269,206 @@ void* realloc(void* old_block, size_t new_size) {
    malloc(), calloc(), or realloc(). */
 void free(void* p) {
   if (p != NULL) {
-    struct block* b = p;
-    struct arena* a = block_to_arena(b);
-    struct desc* d = a->desc;
+    tag_remove(p);
+    free_block(p);
+  }
+}
+
+/* Does the work of free() for nonnull P, without tagging. */
+static void free_block(void* p) {
+  struct block* b = p;
+  struct arena* a = block_to_arena(b);
+  struct desc* d = a->desc;
 
-    if (d != NULL) {
-      /* It's a normal block.  We handle it here. */
+  if (d != NULL) {
+    /* It's a normal block.  Put it in our magazine, draining
+       the magazine first if it is full. */
+    struct magazine* m = &thread_current()->magazines[d - descs];
 
+    ASSERT(!intr_context());
 #ifndef NDEBUG
-      /* Clear the block to help detect use-after-free bugs. */
-      memset(b, 0xcc, d->block_size);
+    /* Clear the block to help detect use-after-free bugs. */
+    memset(b, 0xcc, d->block_size);
 #endif
 
-      lock_acquire(&d->lock);
+    if (m->cnt >= MAGAZINE_SIZE)
+      magazine_drain(d, m, MAGAZINE_SIZE / 2);
+    b->next = m->top;
+    m->top = b;
+    m->cnt++;
+    m->frees++;
+  } else {
+    /* It's a big block.  Free its pages. */
+    enum intr_level old_level = intr_disable();
+    big_frees++;
+    big_pages -= a->free_cnt;
+    intr_set_level(old_level);
+
+    palloc_free_multiple(a, a->free_cnt);
+  }
+}
+
+/* Returns all of the running thread's magazine blocks to their
+   descriptors' free lists.  Called by a thread as it exits. */
+void malloc_thread_exit(void) {
+  struct thread* t = thread_current();
+  size_t i;
+
+  for (i = 0; i < desc_cnt; i++)
+    magazine_drain(&descs[i], &t->magazines[i], 0);
+}
+
+/* Adds the blocks allocated from and freed to thread T's
+   magazines, not yet added to the descriptors' totals, to the
+   classes in STATS, passed as AUX. */
+static void add_magazine_stats(struct thread* t, void* stats_) {
+  struct memstat* stats = stats_;
+  size_t i;
 
-      /* Add block to free list. */
-      list_push_front(&d->free_list, &b->free_elem);
+  for (i = 0; i < desc_cnt; i++) {
+    stats->classes[i].allocs += t->magazines[i].allocs;
+    stats->classes[i].frees += t->magazines[i].frees;
+  }
+}
 
-      /* If the arena is now entirely unused, free it. */
-      if (++a->free_cnt >= d->blocks_per_arena) {
-        size_t i;
+/* Fills in the malloc() members of STATS. */
+void malloc_get_stats(struct memstat* stats) {
+  enum intr_level old_level;
+  size_t i;
+
+  for (i = 0; i < desc_cnt; i++) {
+    struct desc* d = &descs[i];
+    struct memstat_class* c = &stats->classes[i];
+
+    lock_acquire(&d->lock);
+    c->block_size = d->block_size;
+    c->arenas = d->arenas;
+    c->max_arenas = d->max_arenas;
+    c->allocs = d->allocs;
+    c->frees = d->frees;
+    lock_release(&d->lock);
+  }
 
-        ASSERT(a->free_cnt == d->blocks_per_arena);
-        for (i = 0; i < d->blocks_per_arena; i++) {
-          struct block* b = arena_to_block(a, i);
-          list_remove(&b->free_elem);
-        }
-        palloc_free_page(a);
+  old_level = intr_disable();
+  thread_foreach(add_magazine_stats, stats);
+  stats->big_allocs = big_allocs;
+  stats->big_frees = big_frees;
+  stats->big_pages = big_pages;
+  intr_set_level(old_level);
+
+  stats->site_cnt = tag_sites(stats->sites, MEMSTAT_SITE_CNT);
+  stats->untagged = tag_dropped;
+}
+
+/* Prints the usage of each malloc() size class that has been
+   used, and, with allocation-site tagging, the sites with the
+   most bytes outstanding. */
+void malloc_print_stats(void) {
+  static struct memstat stats;
+  uint32_t i;
+
+  malloc_get_stats(&stats);
+  printf("Malloc: block size: arenas/max, blocks allocated/freed:\n");
+  for (i = 0; i < MEMSTAT_CLASS_CNT; i++) {
+    const struct memstat_class* c = &stats.classes[i];
+    if (c->allocs > 0)
+      printf("  %" PRIu32 ": %" PRIu32 "/%" PRIu32 ", %llu/%llu\n", c->block_size, c->arenas,
+             c->max_arenas, c->allocs, c->frees);
+  }
+  printf("  big: %" PRIu32 " pages, %llu/%llu\n", stats.big_pages, stats.big_allocs,
+         stats.big_frees);
+
+  if (malloc_tagging) {
+    printf("Malloc: outstanding by caller (%" PRIu32 " untagged):\n", stats.untagged);
+    for (i = 0; i < stats.site_cnt; i++)
+      printf("  %#" PRIx32 ": %" PRIu32 " blocks, %" PRIu32 " bytes\n", stats.sites[i].caller,
+             stats.sites[i].blocks, stats.sites[i].bytes);
+  }
+}
+
+/* Adds the blocks allocated from and freed to magazine M since
+   the last flush to D's totals.  D's lock must be held. */
+static void magazine_flush(struct desc* d, struct magazine* m) {
+  d->allocs += m->allocs;
+  d->frees += m->frees;
+  m->allocs = m->frees = 0;
+}
+
+/* Moves blocks from D's free list to magazine M, which must
+   belong to the running thread, until M is half full, creating
+   a new arena if the free list runs out.  Returns true if M
+   holds at least one block afterward, false if it is empty
+   because memory is not available. */
+static bool magazine_refill(struct desc* d, struct magazine* m) {
+  lock_acquire(&d->lock);
+  magazine_flush(d, m);
+  while (m->cnt < MAGAZINE_SIZE / 2) {
+    struct block* b;
+    struct arena* a;
+
+    /* If the free list is empty, create a new arena. */
+    if (list_empty(&d->free_list)) {
+      size_t i;
+
+      /* Allocate a page. */
+      a = palloc_get_page(0);
+      if (a == NULL)
+        break;
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      if (++d->arenas > d->max_arenas)
+        d->max_arenas = d->arenas;
+      for (i = 0; i < d->blocks_per_arena; i++) {
+        struct block* b = arena_to_block(a, i);
+        list_push_back(&d->free_list, &b->free_elem);
       }
+    }
+
+    /* Move a block from the free list to the magazine. */
+    b = list_entry(list_pop_front(&d->free_list), struct block, free_elem);
+    a = block_to_arena(b);
+    a->free_cnt--;
+    b->next = m->top;
+    m->top = b;
+    m->cnt++;
+  }
+  lock_release(&d->lock);
+  return m->cnt > 0;
+}
+
+/* Moves blocks from magazine M, which must belong to the running
+   thread, back to D's free list until only KEEP remain, freeing
+   any arena that becomes entirely unused. */
+static void magazine_drain(struct desc* d, struct magazine* m, unsigned keep) {
+  lock_acquire(&d->lock);
+  magazine_flush(d, m);
+  while (m->cnt > keep) {
+    struct block* b = m->top;
+    struct arena* a = block_to_arena(b);
+
+    m->top = b->next;
+    m->cnt--;
+
+    /* Add block to free list. */
+    list_push_front(&d->free_list, &b->free_elem);
 
-      lock_release(&d->lock);
-    } else {
-      /* It's a big block.  Free its pages. */
-      palloc_free_multiple(a, a->free_cnt);
-      return;
+    /* If the arena is now entirely unused, free it. */
+    if (++a->free_cnt >= d->blocks_per_arena) {
+      size_t i;
+
+      ASSERT(a->free_cnt == d->blocks_per_arena);
+      for (i = 0; i < d->blocks_per_arena; i++) {
+        struct block* b = arena_to_block(a, i);
+        list_remove(&b->free_elem);
+      }
+      palloc_free_page(a);
+      d->arenas--;
     }
   }
+  lock_release(&d->lock);
 }
 
 /* Returns the arena that block B is inside. */
@@ -255,3 +493,119 @@ static struct block* arena_to_block(struct arena* a, size_t idx) {
   ASSERT(idx < a->desc->blocks_per_arena);
   return (struct block*)((uint8_t*)a + sizeof *a + idx * a->desc->block_size);
 }
+
+/* Returns the tag table slot where BLOCK's search starts. */
+static size_t tag_hash(const void* block) {
+  return ((uintptr_t)block * 2654435761u) % TAG_SLOTS;
+}
+
+/* Records that BLOCK, of SIZE bytes, was allocated by the call
+   returning to CALLER, if allocation-site tagging is enabled.
+   Returns BLOCK, which may be null. */
+static void* tag_insert(void* block, size_t size, void* caller) {
+  enum intr_level old_level;
+  size_t i;
+
+  if (tags == NULL || block == NULL)
+    return block;
+
+  old_level = spin_lock_irqsave(&tag_lock);
+  if (tag_cnt < TAG_SLOTS / 4 * 3) {
+    for (i = tag_hash(block); tags[i].block != NULL; i = (i + 1) % TAG_SLOTS)
+      continue;
+    tags[i].block = block;
+    tags[i].caller = caller;
+    tags[i].size = size;
+    tag_cnt++;
+  } else
+    tag_dropped++;
+  spin_unlock_irqrestore(&tag_lock, old_level);
+  return block;
+}
+
+/* Forgets BLOCK's tag, if it has one. */
+static void tag_remove(void* block) {
+  enum intr_level old_level;
+  size_t i, j;
+
+  if (tags == NULL)
+    return;
+
+  old_level = spin_lock_irqsave(&tag_lock);
+  for (i = tag_hash(block); tags[i].block != NULL; i = (i + 1) % TAG_SLOTS)
+    if (tags[i].block == block)
+      break;
+  if (tags[i].block != NULL) {
+    /* Empty slot I, then move back any later entry in the same
+       run that would no longer be found from its home slot.  See
+       [Knuth] 6.4 Algorithm R. */
+    tags[i].block = NULL;
+    tag_cnt--;
+    for (j = (i + 1) % TAG_SLOTS; tags[j].block != NULL; j = (j + 1) % TAG_SLOTS) {
+      size_t home = tag_hash(tags[j].block);
+      if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+        tags[i] = tags[j];
+        tags[j].block = NULL;
+        i = j;
+      }
+    }
+  }
+  spin_unlock_irqrestore(&tag_lock, old_level);
+}
+
+/* Returns true if site A has fewer bytes outstanding than site
+   B. */
+static bool site_less(const struct memstat_site* a, const struct memstat_site* b) {
+  return a->bytes < b->bytes;
+}
+
+/* Totals the tagged blocks by caller and stores up to MAX of the
+   callers with the most bytes outstanding in SITES, most first.
+   Returns the number stored. */
+static uint32_t tag_sites(struct memstat_site* sites, uint32_t max) {
+  enum intr_level old_level;
+  uint32_t cnt = 0;
+  size_t i;
+
+  if (tags == NULL || max == 0)
+    return 0;
+
+  old_level = spin_lock_irqsave(&tag_lock);
+
+  /* Total every caller's blocks.  There are no more callers than
+     tags, so the site table never fills. */
+  memset(site_table, 0, TAG_SLOTS * sizeof *site_table);
+  for (i = 0; i < TAG_SLOTS; i++) {
+    const struct tag* t = &tags[i];
+    struct memstat_site* s;
+    size_t j;
+
+    if (t->block == NULL)
+      continue;
+    for (j = tag_hash(t->caller);
+         site_table[j].caller != 0 && site_table[j].caller != (uintptr_t)t->caller;
+         j = (j + 1) % TAG_SLOTS)
+      continue;
+    s = &site_table[j];
+    s->caller = (uintptr_t)t->caller;
+    s->blocks++;
+    s->bytes += t->size;
+  }
+
+  /* Keep the MAX sites with the most bytes, by insertion into
+     SITES, most first. */
+  for (i = 0; i < TAG_SLOTS; i++) {
+    const struct memstat_site* s = &site_table[i];
+    uint32_t j;
+
+    if (s->caller == 0 || (cnt == max && !site_less(&sites[cnt - 1], s)))
+      continue;
+    if (cnt < max)
+      cnt++;
+    for (j = cnt - 1; j > 0 && site_less(&sites[j - 1], s); j--)
+      sites[j] = sites[j - 1];
+    sites[j] = *s;
+  }
+  spin_unlock_irqrestore(&tag_lock, old_level);
+  return cnt;
+}
@@ -2,12 +2,33 @@
 #define THREADS_MALLOC_H
 
 #include <debug.h>
+#include <memstat.h>
+#include <stdbool.h>
 #include <stddef.h>
 
+/* Number of block sizes, 16 bytes through 1 kB, that malloc()
+   serves from arenas, each with its own descriptor. */
+#define MALLOC_DESC_CNT 7
+
+/* A thread's private stock of free blocks of one size, which it
+   can allocate from and free to without taking any lock. */
+struct magazine {
+  struct block* top; /* Most recently freed block. */
+  unsigned cnt;      /* Number of blocks. */
+  unsigned allocs;   /* Blocks allocated since last flush. */
+  unsigned frees;    /* Blocks freed since last flush. */
+};
+
+/* Record allocation sites? */
+extern bool malloc_tagging;
+
 void malloc_init(void);
 void* malloc(size_t) __attribute__((malloc));
 void* calloc(size_t, size_t) __attribute__((malloc));
 void* realloc(void*, size_t);
 void free(void*);
+void malloc_thread_exit(void);
+void malloc_get_stats(struct memstat*);
+void malloc_print_stats(void);
 
 #endif /* threads/malloc.h */
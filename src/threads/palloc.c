@@ -2,11 +2,13 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -23,13 +25,65 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is managed as a binary buddy system.  Free pages are
+   kept in blocks of 2**ORDER pages, each aligned to a multiple of
+   its size from the start of the pool, on one free list per
+   order.  An allocation takes a block of the smallest sufficient
+   order, splitting a larger block in halves ("buddies") as
+   needed, and gives back the unused tail pages of the block if
+   the request was not a power of 2.  A freed block is merged
+   with its buddy, if that is free too, and so on up, so that free
+   pages coalesce into the largest aligned runs.  Both take time
+   logarithmic in the pool size.
+
+   Zeroing pages for PAL_ZERO requests is kept off the allocation
+   path where possible: when it has nothing else to do, the idle
+   thread takes free pages out of the buddy system, zeroes them,
+   and sets them aside, so that single-page PAL_ZERO requests can
+   be served without zeroing.  Pages set aside are still free, and
+   are given back to the buddy system if it cannot satisfy a
+   request without them. */
+
+/* Number of block orders.  The largest block is 2**(ORDER_CNT - 1)
+   pages, 128 MB. */
+#define ORDER_CNT 16
+
+/* Value in a pool's ORDERS for a page that does not begin a free
+   block. */
+#define NOT_FREE (-1)
+
+/* Maximum number of pre-zeroed pages set aside per pool. */
+#define ZEROED_MAX 64
 
 /* A memory pool. */
 struct pool {
-  struct lock lock;        /* Mutual exclusion. */
-  struct bitmap* used_map; /* Bitmap of free pages. */
-  uint8_t* base;           /* Base of pool. */
+  const char* name;                  /* Name (for statistics). */
+  struct spinlock lock;              /* Mutual exclusion. */
+  struct bitmap* used_map;           /* Bitmap of used pages. */
+  int8_t* orders;                    /* Order of free block at each page. */
+  struct list free_lists[ORDER_CNT]; /* Free blocks, by order. */
+  size_t free_cnt;                   /* Number of free pages. */
+  uint8_t* base;                     /* Base of pool. */
+
+  /* Free pages zeroed by the idle thread, kept out of the buddy
+     system and marked as used in USED_MAP. */
+  struct list zeroed_list; /* Pre-zeroed pages. */
+  size_t zeroed_cnt;       /* Number of pre-zeroed pages. */
+  uint64_t zero_allocs;    /* PAL_ZERO allocations. */
+  uint64_t zero_hits;      /* ...served from ZEROED_LIST. */
+
+  /* Statistics. */
+  size_t max_used;   /* Most pages allocated at once. */
+  uint64_t allocs;   /* Successful allocation calls. */
+  uint64_t failures; /* Failed allocation calls. */
+  uint64_t frees;    /* Free calls. */
+};
+
+/* A free block, stored in its first page. */
+struct free_block {
+  struct list_elem elem; /* Element in pool's free list. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -37,6 +91,15 @@ static struct pool kernel_pool, user_pool;
 
 static void init_pool(struct pool*, void* base, size_t page_cnt, const char* name);
 static bool page_from_pool(const struct pool*, void* page);
+static size_t alloc_pages(struct pool*, size_t page_cnt);
+static void release_zeroed(struct pool*);
+static bool zero_page(struct pool*);
+static size_t buddy_alloc(struct pool*, int order);
+static void buddy_free(struct pool*, size_t page_idx, int order);
+static void buddy_free_range(struct pool*, size_t page_idx, size_t page_cnt);
+static void buddy_claim_range(struct pool*, size_t page_idx, size_t page_cnt);
+static void get_pool_stats(struct pool*, struct memstat_pool*);
+static void print_pool_stats(struct pool*);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -64,23 +127,48 @@ void palloc_init(size_t user_page_limit) {
    FLAGS, in which case the kernel panics. */
 void* palloc_get_multiple(enum palloc_flags flags, size_t page_cnt) {
   struct pool* pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-  void* pages;
-  size_t page_idx;
+  enum intr_level old_level;
+  void* pages = NULL;
+  bool zeroed = false;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire(&pool->lock);
-  page_idx = bitmap_scan_and_flip(pool->used_map, 0, page_cnt, false);
-  lock_release(&pool->lock);
-
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
-  else
-    pages = NULL;
+  old_level = spin_lock_irqsave(&pool->lock);
+  if ((flags & PAL_ZERO) && page_cnt == 1 && !list_empty(&pool->zeroed_list)) {
+    /* Take a page that is already zeroed. */
+    pages = list_pop_front(&pool->zeroed_list);
+    pool->zeroed_cnt--;
+    pool->free_cnt--;
+    zeroed = true;
+  } else {
+    size_t page_idx = alloc_pages(pool, page_cnt);
+    if (page_idx == BITMAP_ERROR && pool->zeroed_cnt > 0) {
+      release_zeroed(pool);
+      page_idx = alloc_pages(pool, page_cnt);
+    }
+    if (page_idx != BITMAP_ERROR)
+      pages = pool->base + PGSIZE * page_idx;
+  }
+  if (flags & PAL_ZERO) {
+    pool->zero_allocs++;
+    if (zeroed)
+      pool->zero_hits++;
+  }
+  if (pages != NULL) {
+    size_t used = bitmap_size(pool->used_map) - pool->free_cnt;
+    if (used > pool->max_used)
+      pool->max_used = used;
+    pool->allocs++;
+  } else
+    pool->failures++;
+  spin_unlock_irqrestore(&pool->lock, old_level);
 
   if (pages != NULL) {
-    if (flags & PAL_ZERO)
+    /* A pre-zeroed page held only its list element. */
+    if (zeroed)
+      memset(pages, 0, sizeof(struct list_elem));
+    else if (flags & PAL_ZERO)
       memset(pages, 0, PGSIZE * page_cnt);
   } else {
     if (flags & PAL_ASSERT)
@@ -102,6 +190,7 @@ void* palloc_get_page(enum palloc_flags flags) { return palloc_get_multiple(flag
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void palloc_free_multiple(void* pages, size_t page_cnt) {
   struct pool* pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT(pg_ofs(pages) == 0);
@@ -121,20 +210,51 @@ void palloc_free_multiple(void* pages, size_t page_cnt) {
   memset(pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = spin_lock_irqsave(&pool->lock);
   ASSERT(bitmap_all(pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple(pool->used_map, page_idx, page_cnt, false);
+  buddy_free_range(pool, page_idx, page_cnt);
+  pool->free_cnt += page_cnt;
+  pool->frees++;
+  spin_unlock_irqrestore(&pool->lock, old_level);
 }
 
 /* Frees the page at PAGE. */
 void palloc_free_page(void* page) { palloc_free_multiple(page, 1); }
 
+/* Zeroes one free page and sets it aside for a later PAL_ZERO
+   request, if a pool has fewer than ZEROED_MAX pre-zeroed pages.
+   Returns true if a page was zeroed, false if there was no need
+   or no free page.  Called by the idle thread, with interrupts
+   on. */
+bool palloc_zero_idle(void) {
+  ASSERT(intr_get_level() == INTR_ON);
+
+  return zero_page(&kernel_pool) || zero_page(&user_pool);
+}
+
+/* Fills in the page pool members of STATS. */
+void palloc_get_stats(struct memstat* stats) {
+  get_pool_stats(&kernel_pool, &stats->kernel_pool);
+  get_pool_stats(&user_pool, &stats->user_pool);
+}
+
+/* Prints usage and a fragmentation report for each pool. */
+void palloc_print_stats(void) {
+  print_pool_stats(&kernel_pool);
+  print_pool_stats(&user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void init_pool(struct pool* p, void* base, size_t page_cnt, const char* name) {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP(bitmap_buf_size(page_cnt), PGSIZE);
+  size_t bm_pages;
+  int i;
+
+  /* We'll put the pool's used_map and orders at its base.
+     Calculate the space needed for them and subtract it from the
+     pool's size. */
+  bm_pages = DIV_ROUND_UP(bitmap_buf_size(page_cnt) + page_cnt, PGSIZE);
   if (bm_pages > page_cnt)
     PANIC("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
@@ -142,9 +262,23 @@ static void init_pool(struct pool* p, void* base, size_t page_cnt, const char* n
   printf("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init(&p->lock);
-  p->used_map = bitmap_create_in_buf(page_cnt, base, bm_pages * PGSIZE);
+  p->name = name;
+  spinlock_init(&p->lock, name);
+  p->used_map = bitmap_create_in_buf(page_cnt, base, bitmap_buf_size(page_cnt));
+  p->orders = (int8_t*)base + bitmap_buf_size(page_cnt);
+  memset(p->orders, NOT_FREE, page_cnt);
+  for (i = 0; i < ORDER_CNT; i++)
+    list_init(&p->free_lists[i]);
+  list_init(&p->zeroed_list);
+  p->zeroed_cnt = 0;
+  p->zero_allocs = p->zero_hits = 0;
+  p->max_used = 0;
+  p->allocs = p->failures = p->frees = 0;
   p->base = base + bm_pages * PGSIZE;
+
+  /* Put all of the pool's pages on its free lists. */
+  buddy_free_range(p, 0, page_cnt);
+  p->free_cnt = page_cnt;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -156,3 +290,242 @@ static bool page_from_pool(const struct pool* pool, void* page) {
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Removes PAGE_CNT contiguous free pages from POOL's buddy
+   system, marks them used, and returns the index of the first,
+   or BITMAP_ERROR if there is no such run of pages.  POOL's lock
+   must be held. */
+static size_t alloc_pages(struct pool* pool, size_t page_cnt) {
+  size_t page_idx;
+  int order;
+
+  /* Find the order of the smallest block of at least PAGE_CNT
+     pages. */
+  for (order = 0; order < ORDER_CNT && ((size_t)1 << order) < page_cnt; order++)
+    continue;
+
+  page_idx = order < ORDER_CNT ? buddy_alloc(pool, order) : BITMAP_ERROR;
+  if (page_idx != BITMAP_ERROR) {
+    /* Give back the part of the block that was not asked for. */
+    buddy_free_range(pool, page_idx + page_cnt, ((size_t)1 << order) - page_cnt);
+  } else {
+    /* No free block is large enough, but a long enough run of
+       free pages may still straddle block boundaries.  Search
+       for one the slow way. */
+    page_idx = bitmap_scan(pool->used_map, 0, page_cnt, false);
+    if (page_idx != BITMAP_ERROR)
+      buddy_claim_range(pool, page_idx, page_cnt);
+  }
+  if (page_idx != BITMAP_ERROR) {
+    pool->free_cnt -= page_cnt;
+    ASSERT(bitmap_none(pool->used_map, page_idx, page_cnt));
+    bitmap_set_multiple(pool->used_map, page_idx, page_cnt, true);
+  }
+  return page_idx;
+}
+
+/* Gives all of POOL's pre-zeroed pages back to its buddy system.
+   POOL's lock must be held. */
+static void release_zeroed(struct pool* pool) {
+  while (!list_empty(&pool->zeroed_list)) {
+    void* page = list_pop_front(&pool->zeroed_list);
+    size_t page_idx = pg_no(page) - pg_no(pool->base);
+
+    bitmap_reset(pool->used_map, page_idx);
+    buddy_free(pool, page_idx, 0);
+  }
+  pool->zeroed_cnt = 0;
+}
+
+/* Zeroes a free page from POOL's buddy system and adds it to
+   POOL's pre-zeroed pages, unless there are enough of those
+   already.  Returns true if successful, false otherwise. */
+static bool zero_page(struct pool* pool) {
+  enum intr_level old_level;
+  size_t page_idx = BITMAP_ERROR;
+  uint8_t* page;
+
+  /* Take the page without changing the free count, since it
+     stays free. */
+  old_level = spin_lock_irqsave(&pool->lock);
+  if (pool->zeroed_cnt < ZEROED_MAX) {
+    page_idx = buddy_alloc(pool, 0);
+    if (page_idx != BITMAP_ERROR)
+      bitmap_mark(pool->used_map, page_idx);
+  }
+  spin_unlock_irqrestore(&pool->lock, old_level);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  page = pool->base + PGSIZE * page_idx;
+  memset(page, 0, PGSIZE);
+
+  old_level = spin_lock_irqsave(&pool->lock);
+  list_push_back(&pool->zeroed_list, (struct list_elem*)page);
+  pool->zeroed_cnt++;
+  spin_unlock_irqrestore(&pool->lock, old_level);
+  return true;
+}
+
+/* Returns the free block at page PAGE_IDX in POOL. */
+static struct free_block* idx_to_block(struct pool* pool, size_t page_idx) {
+  return (struct free_block*)(pool->base + PGSIZE * page_idx);
+}
+
+/* Adds the free block of 2**ORDER pages at PAGE_IDX to POOL's
+   free lists. */
+static void push_block(struct pool* pool, size_t page_idx, int order) {
+  pool->orders[page_idx] = order;
+  list_push_front(&pool->free_lists[order], &idx_to_block(pool, page_idx)->elem);
+}
+
+/* Removes the free block at PAGE_IDX from POOL's free lists. */
+static void remove_block(struct pool* pool, size_t page_idx) {
+  pool->orders[page_idx] = NOT_FREE;
+  list_remove(&idx_to_block(pool, page_idx)->elem);
+}
+
+/* Removes a block of 2**ORDER pages from POOL's free lists,
+   splitting a larger block if necessary, and returns the index of
+   its first page, or BITMAP_ERROR if there is no large enough
+   block.  POOL's lock must be held. */
+static size_t buddy_alloc(struct pool* pool, int order) {
+  size_t page_idx;
+  int o;
+
+  for (o = order; o < ORDER_CNT; o++)
+    if (!list_empty(&pool->free_lists[o]))
+      break;
+  if (o == ORDER_CNT)
+    return BITMAP_ERROR;
+
+  page_idx = pg_no(list_front(&pool->free_lists[o])) - pg_no(pool->base);
+  remove_block(pool, page_idx);
+
+  /* Split the block, keeping the lower half each time and
+     freeing the upper half. */
+  while (o > order) {
+    o--;
+    push_block(pool, page_idx + ((size_t)1 << o), o);
+  }
+  return page_idx;
+}
+
+/* Adds the block of 2**ORDER pages at PAGE_IDX to POOL's free
+   lists, merging it with its buddy as long as that is free.
+   POOL's lock must be held. */
+static void buddy_free(struct pool* pool, size_t page_idx, int order) {
+  size_t page_cnt = bitmap_size(pool->used_map);
+
+  while (order < ORDER_CNT - 1) {
+    size_t buddy_idx = page_idx ^ ((size_t)1 << order);
+
+    if (buddy_idx + ((size_t)1 << order) > page_cnt || pool->orders[buddy_idx] != order)
+      break;
+    remove_block(pool, buddy_idx);
+    if (buddy_idx < page_idx)
+      page_idx = buddy_idx;
+    order++;
+  }
+  push_block(pool, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, as the
+   largest aligned blocks that they divide into.  POOL's lock must
+   be held. */
+static void buddy_free_range(struct pool* pool, size_t page_idx, size_t page_cnt) {
+  size_t end = page_idx + page_cnt;
+
+  while (page_idx < end) {
+    int order = 0;
+
+    while (order < ORDER_CNT - 1 && page_idx % ((size_t)2 << order) == 0
+           && page_idx + ((size_t)2 << order) <= end)
+      order++;
+    buddy_free(pool, page_idx, order);
+    page_idx += (size_t)1 << order;
+  }
+}
+
+/* Removes the PAGE_CNT free pages starting at PAGE_IDX from
+   POOL's free lists, by removing every free block that overlaps
+   them and freeing again the parts of those blocks outside the
+   range.  POOL's lock must be held. */
+static void buddy_claim_range(struct pool* pool, size_t page_idx, size_t page_cnt) {
+  size_t end = page_idx + page_cnt;
+  size_t p = page_idx;
+
+  while (p < end) {
+    size_t head = p, block_end;
+    int order;
+
+    /* Find the free block that page P is in. */
+    for (order = 0; order < ORDER_CNT; order++) {
+      head = p & ~(((size_t)1 << order) - 1);
+      if (pool->orders[head] == order)
+        break;
+    }
+    ASSERT(order < ORDER_CNT);
+    block_end = head + ((size_t)1 << order);
+
+    remove_block(pool, head);
+    if (head < page_idx)
+      buddy_free_range(pool, head, page_idx - head);
+    if (block_end > end)
+      buddy_free_range(pool, end, block_end - end);
+    p = block_end;
+  }
+}
+
+/* Copies POOL's usage into STATS. */
+static void get_pool_stats(struct pool* pool, struct memstat_pool* stats) {
+  enum intr_level old_level = spin_lock_irqsave(&pool->lock);
+
+  stats->pages = bitmap_size(pool->used_map);
+  stats->used = stats->pages - pool->free_cnt;
+  stats->max_used = pool->max_used;
+  stats->allocs = pool->allocs;
+  stats->failures = pool->failures;
+  stats->frees = pool->frees;
+  spin_unlock_irqrestore(&pool->lock, old_level);
+}
+
+/* Prints POOL's usage, the number of free blocks of each order
+   in POOL, and how fragmented its free pages are: the share of
+   them that are
+   not in the longest run of free pages, which is how much of the
+   free memory a single request cannot use.  Pre-zeroed pages
+   count as used for this purpose, since they are not in the
+   buddy system. */
+static void print_pool_stats(struct pool* pool) {
+  size_t counts[ORDER_CNT];
+  size_t page_cnt, free_cnt, run = 0, longest = 0;
+  enum intr_level old_level;
+  size_t page_idx;
+  int i;
+
+  old_level = spin_lock_irqsave(&pool->lock);
+  page_cnt = bitmap_size(pool->used_map);
+  free_cnt = pool->free_cnt;
+  for (i = 0; i < ORDER_CNT; i++)
+    counts[i] = list_size(&pool->free_lists[i]);
+  for (page_idx = 0; page_idx < page_cnt; page_idx++) {
+    run = bitmap_test(pool->used_map, page_idx) ? 0 : run + 1;
+    if (run > longest)
+      longest = run;
+  }
+  spin_unlock_irqrestore(&pool->lock, old_level);
+
+  printf("Palloc: %s: %zu of %zu pages free, longest free run %zu pages, %zu%% fragmented\n",
+         pool->name, free_cnt, page_cnt, longest,
+         free_cnt > 0 ? (free_cnt - longest) * 100 / free_cnt : 0);
+  printf("  %zu pages used at most, %llu allocations, %llu failed, %llu frees\n", pool->max_used,
+         pool->allocs, pool->failures, pool->frees);
+  printf("  %zu pages pre-zeroed, %llu of %llu zeroed allocations served pre-zeroed\n",
+         pool->zeroed_cnt, pool->zero_hits, pool->zero_allocs);
+  printf("  free blocks by order:");
+  for (i = 0; i < ORDER_CNT; i++)
+    if (counts[i] > 0)
+      printf(" %d:%zu", i, counts[i]);
+  printf("\n");
+}
@@ -0,0 +1,214 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A slab cache divides whole pages, each called a slab, into
+   objects of its size.  Each slab begins with a struct slab,
+   followed by as many objects as fit in the rest of the page, so
+   the slab that an object belongs to is found by rounding its
+   address down to a page boundary.  A slab's free objects are
+   kept on a singly linked list threaded through the objects
+   themselves.
+
+   A cache keeps a list of its slabs that have at least one free
+   object.  A slab that fills up leaves the list, and rejoins it
+   at the front when an object is freed, so that allocations are
+   packed into partly used slabs and empty slabs can be given
+   back to the page allocator. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Slab. */
+struct slab {
+  unsigned magic;           /* Always set to SLAB_MAGIC. */
+  struct slab_cache* cache; /* Owning cache. */
+  struct list_elem elem;    /* Element in cache's slab list. */
+  struct object* free;      /* First free object. */
+  size_t in_use;            /* Number of allocated objects. */
+};
+
+/* Free object. */
+struct object {
+  struct object* next; /* Next free object in the same slab. */
+};
+
+/* All caches that have been used, in order of first use. */
+static struct list slab_caches = LIST_INITIALIZER(slab_caches);
+
+static void cache_setup(struct slab_cache*);
+static struct slab* slab_create(struct slab_cache*);
+static struct slab* object_to_slab(struct slab_cache*, void*);
+
+/* Allocates and returns an object from CACHE, passing it to the
+   cache's constructor, if any.  Returns a null pointer if memory
+   is not available. */
+void* slab_alloc(struct slab_cache* c) {
+  enum intr_level old_level;
+  struct slab* s;
+  struct object* o;
+
+  ASSERT(c != NULL);
+  ASSERT(!intr_context());
+
+  if (!c->registered)
+    cache_setup(c);
+
+  old_level = spin_lock_irqsave(&c->lock);
+  while (list_empty(&c->slabs)) {
+    /* Get a new slab.  The page allocator may sleep, so drop the
+       lock meanwhile; another thread may add a slab first, in
+       which case this one is still added, as an empty slab. */
+    spin_unlock_irqrestore(&c->lock, old_level);
+    s = slab_create(c);
+    if (s == NULL)
+      return NULL;
+    old_level = spin_lock_irqsave(&c->lock);
+    list_push_back(&c->slabs, &s->elem);
+    c->empty_cnt++;
+    c->slab_cnt++;
+  }
+
+  /* Take the first free object in the first slab. */
+  s = list_entry(list_front(&c->slabs), struct slab, elem);
+  o = s->free;
+  s->free = o->next;
+  if (s->in_use++ == 0)
+    c->empty_cnt--;
+  if (s->free == NULL)
+    list_remove(&s->elem);
+
+  c->allocs++;
+  if (++c->active > c->max_active)
+    c->max_active = c->active;
+  spin_unlock_irqrestore(&c->lock, old_level);
+
+  if (c->ctor != NULL)
+    c->ctor(o);
+  return o;
+}
+
+/* Frees object P, which must have been allocated from CACHE with
+   slab_alloc().  Does nothing if P is a null pointer. */
+void slab_free(struct slab_cache* c, void* p) {
+  enum intr_level old_level;
+  struct slab* s;
+  struct object* o = p;
+  bool release = false;
+
+  ASSERT(c != NULL);
+  ASSERT(!intr_context());
+
+  if (p == NULL)
+    return;
+  s = object_to_slab(c, p);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs. */
+  memset(p, 0xcc, c->size);
+#endif
+
+  old_level = spin_lock_irqsave(&c->lock);
+  ASSERT(s->in_use > 0);
+  if (s->free == NULL)
+    list_push_front(&c->slabs, &s->elem);
+  o->next = s->free;
+  s->free = o;
+  c->frees++;
+  c->active--;
+
+  /* If the slab is now unused, keep it if it is the only empty
+     one, otherwise give it back. */
+  if (--s->in_use == 0) {
+    if (c->empty_cnt > 0) {
+      list_remove(&s->elem);
+      c->slab_cnt--;
+      release = true;
+    } else
+      c->empty_cnt++;
+  }
+  spin_unlock_irqrestore(&c->lock, old_level);
+
+  if (release) {
+    s->magic = 0;
+    palloc_free_page(s);
+  }
+}
+
+/* Prints statistics for every cache that has been used. */
+void slab_print_stats(void) {
+  struct list_elem* e;
+
+  if (list_empty(&slab_caches))
+    return;
+
+  /* Caches are only ever appended, so the list can be walked
+     without synchronization. */
+  printf("Slab caches: object size, objects active/peak, slabs, allocs, frees:\n");
+  for (e = list_begin(&slab_caches); e != list_end(&slab_caches); e = list_next(e)) {
+    const struct slab_cache* c = list_entry(e, struct slab_cache, elem);
+    printf("  %s: %zu, %zu/%zu, %zu, %llu, %llu\n", c->name, c->size, c->active, c->max_active,
+           c->slab_cnt, c->allocs, c->frees);
+  }
+}
+
+/* Computes the layout of CACHE's slabs and adds CACHE to the
+   list of all caches, the first time that CACHE is used. */
+static void cache_setup(struct slab_cache* c) {
+  enum intr_level old_level = intr_disable();
+
+  if (!c->registered) {
+    size_t size = c->size > sizeof(struct object) ? c->size : sizeof(struct object);
+
+    c->obj_size = ROUND_UP(size, sizeof(void*));
+    c->objs_per_slab = (PGSIZE - sizeof(struct slab)) / c->obj_size;
+    ASSERT(c->objs_per_slab > 0);
+    spinlock_init(&c->lock, c->name);
+    list_push_back(&slab_caches, &c->elem);
+    c->registered = true;
+  }
+  intr_set_level(old_level);
+}
+
+/* Allocates a new slab for CACHE, with all of its objects free.
+   Returns a null pointer if memory is not available. */
+static struct slab* slab_create(struct slab_cache* c) {
+  struct slab* s = palloc_get_page(0);
+  uint8_t* first;
+  size_t i;
+
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->in_use = 0;
+  s->free = NULL;
+  first = (uint8_t*)(s + 1);
+  for (i = c->objs_per_slab; i-- > 0;) {
+    struct object* o = (struct object*)(first + i * c->obj_size);
+    o->next = s->free;
+    s->free = o;
+  }
+  return s;
+}
+
+/* Returns the slab that object P, allocated from CACHE, is
+   in. */
+static struct slab* object_to_slab(struct slab_cache* c, void* p) {
+  struct slab* s = pg_round_down(p);
+
+  /* Check that the slab is valid and belongs to C. */
+  ASSERT(s->magic == SLAB_MAGIC);
+  ASSERT(s->cache == c);
+
+  /* Check that the object is properly aligned in the slab. */
+  ASSERT((pg_ofs(p) - sizeof *s) % c->obj_size == 0);
+
+  return s;
+}
@@ -0,0 +1,63 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/synch.h"
+
+/* Object caches.
+
+   A slab cache hands out objects of one exact size, typically
+   one kind of kernel structure, carved from pages ("slabs") that
+   hold nothing else.  Compared to malloc(), which rounds every
+   request up to a power of 2, this wastes less memory on objects
+   such as 512-byte disk sectors, and each cache has a lock of its
+   own, so allocations of one kind do not contend with those of
+   another.
+
+   A cache may have a constructor, which is called on each object
+   as it is allocated, for example to clear it.  One empty slab
+   is kept per cache, so that a cache whose use goes up and down
+   by a few objects does not keep going back to the page
+   allocator.
+
+   A cache is defined statically with SLAB_CACHE_INITIALIZER and
+   needs no other initialization.  Like malloc(), slab_alloc() and
+   slab_free() may sleep, so they must not be called from
+   interrupt handlers. */
+
+typedef void slab_ctor_func(void* object);
+
+/* A cache of objects of one size. */
+struct slab_cache {
+  const char* name;      /* Name (for statistics). */
+  size_t size;           /* Size of each object in bytes. */
+  slab_ctor_func* ctor;  /* Called on each object allocated, or null. */
+  struct spinlock lock;  /* Protects the members below. */
+  bool registered;       /* Set up and in the list of all caches? */
+  struct list_elem elem; /* Element in the list of all caches. */
+  size_t obj_size;       /* SIZE rounded up for alignment. */
+  size_t objs_per_slab;  /* Number of objects in a slab. */
+  struct list slabs;     /* Slabs with free objects, partly used first. */
+  size_t empty_cnt;      /* Slabs with no allocated objects. */
+
+  /* Statistics. */
+  size_t slab_cnt;   /* Slabs allocated. */
+  size_t active;     /* Objects allocated. */
+  size_t max_active; /* Most objects allocated at once. */
+  uint64_t allocs;   /* Calls to slab_alloc(). */
+  uint64_t frees;    /* Calls to slab_free(). */
+};
+
+/* Initializer for CACHE, named NAME, of objects of SIZE bytes,
+   each passed to CTOR as it is allocated if CTOR is nonnull. */
+#define SLAB_CACHE_INITIALIZER(CACHE, NAME, SIZE, CTOR)                                            \
+  { .name = NAME, .size = SIZE, .ctor = CTOR, .slabs = LIST_INITIALIZER((CACHE).slabs) }
+
+void* slab_alloc(struct slab_cache*) __attribute__((malloc));
+void slab_free(struct slab_cache*, void*);
+void slab_print_stats(void);
+
+#endif /* threads/slab.h */
@@ -26,17 +26,78 @@
 #include "threads/synch.h"
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "devices/timer.h"
+
+/* If false (default), lock contention is not measured.
+   If true, set by kernel command-line option "-lockprof", it is
+   measured per lock class and reported at shutdown. */
+bool lock_profiling;
+
+/* Every lock class that has had a lock initialized. */
+static struct list lock_classes = LIST_INITIALIZER(lock_classes);
+
+/* One semaphore in a list. */
+struct semaphore_elem {
+  struct list_elem elem;      /* List element. */
+  struct semaphore semaphore; /* This semaphore. */
+  struct thread* thread;      /* Thread waiting on SEMAPHORE. */
+};
 
 /* Compare the effective_priority of two different threads
    Return True if effective_priority of elem1 is smaller. */
-bool comp_sema_priority(const struct list_elem* elem1, const struct list_elem* elem2, void* aux) {
+bool comp_sema_priority(const struct list_elem* elem1, const struct list_elem* elem2,
+                        void* aux UNUSED) {
   struct thread* t1 = list_entry(elem1, struct thread, elem);
   struct thread* t2 = list_entry(elem2, struct thread, elem);
   return t1->effective_priority < t2->effective_priority;
 }
 
+/* Compare the effective_priorities of the threads waiting in two
+   semaphore_elems of a condition variable.
+   Return True if effective_priority of elem1's thread is smaller. */
+bool comp_cond_priority(const struct list_elem* elem1, const struct list_elem* elem2,
+                        void* aux UNUSED) {
+  struct semaphore_elem* sema1 = list_entry(elem1, struct semaphore_elem, elem);
+  struct semaphore_elem* sema2 = list_entry(elem2, struct semaphore_elem, elem);
+  return sema1->thread->effective_priority < sema2->thread->effective_priority;
+}
+
+/* Inserts ELEM into WAITERS, a list of waiters kept in order of
+   descending priority as judged by LESS, behind every waiter of
+   equal or higher priority.  The scan starts from the back, so
+   that the common case of waiters of equal priority takes
+   constant time.  Interrupts must be off. */
+static void insert_waiter(struct list* waiters, struct list_elem* elem, list_less_func* less) {
+  struct list_elem* e;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  for (e = list_rbegin(waiters); e != list_rend(waiters); e = list_prev(e))
+    if (!less(e, elem, NULL))
+      break;
+  list_insert(list_next(e), elem);
+}
+
+/* Called when the effective priority of T, which is not on the
+   ready queue, has changed.  If T is waiting on a semaphore or a
+   condition variable, moves it to its new place in line.
+   Interrupts must be off. */
+void synch_requeue(struct thread* t) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (t->wait_sema != NULL) {
+    list_remove(&t->elem);
+    insert_waiter(&t->wait_sema->waiters, &t->elem, comp_sema_priority);
+  }
+  if (t->wait_cond != NULL) {
+    list_remove(t->cond_elem);
+    insert_waiter(&t->wait_cond->waiters, t->cond_elem, comp_cond_priority);
+  }
+}
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -48,7 +109,7 @@ void sema_init(struct semaphore* sema, unsigned value) {
   ASSERT(sema != NULL);
 
   sema->value = value;
-  list_init(&sema->waiters);
+  list_init(&sema->waiters); /* Highest priority first. */
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -65,8 +126,9 @@ void sema_down(struct semaphore* sema) {
 
   old_level = intr_disable();
   while (sema->value == 0) {
-    list_push_back(&sema->waiters, &thread_current()->elem);
-
+    struct thread* cur = thread_current();
+    cur->wait_sema = sema;
+    insert_waiter(&sema->waiters, &cur->elem, comp_sema_priority);
     thread_block();
   }
   sema->value--;
@@ -104,16 +166,13 @@ void sema_up(struct semaphore* sema) {
 
   old_level = intr_disable();
 
-  // if (!list_empty(&sema->waiters))
-  //   thread_unblock(list_entry(list_pop_front(&sema->waiters), struct thread, elem));
-
   /* Project 2 */
+  /* The waiters are kept highest priority first. */
   if (!list_empty(&sema->waiters)) {
-    struct list_elem* unblock_elem = list_max(&sema->waiters, comp_sema_priority, (void*)NULL);
-    list_remove(unblock_elem);
-    struct thread* thread_to_unblock = list_entry(unblock_elem, struct thread, elem);
+    struct thread* thread_to_unblock =
+        list_entry(list_pop_front(&sema->waiters), struct thread, elem);
+    thread_to_unblock->wait_sema = NULL;
     thread_unblock(thread_to_unblock);
-    thread_to_unblock->donee = NULL;
   }
 
   sema->value++;
@@ -168,11 +227,73 @@ static void sema_test_helper(void* sema_) {
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
    instead of a lock. */
-void lock_init(struct lock* lock) {
+void lock_init_class(struct lock* lock, struct lock_class* class) {
+  enum intr_level old_level;
+
   ASSERT(lock != NULL);
+  ASSERT(class != NULL);
 
   lock->holder = NULL;
   sema_init(&lock->semaphore, 1);
+  lock->class = class;
+
+  old_level = intr_disable();
+  if (!class->registered) {
+    class->registered = true;
+    list_push_back(&lock_classes, &class->elem);
+  }
+  intr_set_level(old_level);
+}
+
+/* Returns the priority that LOCK donates to its holder: the
+   effective priority of its highest-priority waiter, which is
+   first in line, or PRI_MIN if there are no waiters.
+   Interrupts must be off. */
+static int lock_donation(struct lock* lock) {
+  struct list* waiters = &lock->semaphore.waiters;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (list_empty(waiters))
+    return PRI_MIN;
+  return list_entry(list_front(waiters), struct thread, elem)->effective_priority;
+}
+
+/* Returns the effective priority that T should have: its base
+   priority, raised to the highest priority donated through any of
+   the locks it holds.  Takes time proportional to the number of
+   locks T holds.  Interrupts must be off. */
+int synch_effective_priority(struct thread* t) {
+  int priority = t->priority;
+  struct list_elem* e;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  for (e = list_begin(&t->held_locks); e != list_end(&t->held_locks); e = list_next(e)) {
+    int donation = lock_donation(list_entry(e, struct lock, elem));
+    if (donation > priority)
+      priority = donation;
+  }
+  return priority;
+}
+
+/* Makes the current thread the holder of LOCK, which it has just
+   downed.  Interrupts must be off. */
+static void lock_take(struct lock* lock) {
+  struct thread* cur = thread_current();
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  lock->holder = cur;
+  list_push_back(&cur->held_locks, &lock->elem);
+  if (lock_profiling) {
+    lock->acquired = timer_tsc();
+    lock->class->acquisitions++;
+  }
+
+  /* Threads still waiting for LOCK now donate to us. */
+  if (!thread_mlfqs && lock_donation(lock) > cur->effective_priority)
+    thread_set_effective_priority(cur, lock_donation(lock));
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -191,41 +312,43 @@ void lock_acquire(struct lock* lock) {
   enum intr_level old_level = intr_disable();
 
   struct thread* current_thread = thread_current();
-  struct thread* lock_holder = lock->holder;
-  if (lock_holder) {
-    struct thread* lock_holder = lock->holder;
-    current_thread->donee = lock_holder;
-    int current_thread_eff_prio = current_thread->effective_priority;
-    /* add current thread to the list of all threads donoting to lock holder */
-    list_push_back(&lock_holder->donors, &current_thread->donor_elem);
-
-    if (current_thread_eff_prio > lock_holder->effective_priority) {
-      /* Current_thread should donate its priority to lock_holder. */
-      lock_holder->effective_priority = current_thread_eff_prio;
-      /* Recursive donation: We recurse through the nested chain of locks that the
-         holder is waiting on in order to update priorities of all holders */
-      struct thread* cur_holder = lock_holder;
-      while (cur_holder->donee) {
-        cur_holder = cur_holder->donee;
-        ASSERT(cur_holder->effective_priority < current_thread->effective_priority);
-        cur_holder->effective_priority = current_thread->effective_priority;
-      }
+
+  uint64_t start = lock->holder != NULL ? timer_tsc() : 0;
+
+  /* There is no priority donation under the MLFQS scheduler. */
+  if (lock->holder != NULL && !thread_mlfqs) {
+    int priority = current_thread->effective_priority;
+    struct lock* l;
+
+    current_thread->waiting_lock = lock;
+
+    /* Donate our priority to the holder and, recursively, along
+       the chain of locks that holders are waiting on.  Once a
+       holder already has our priority, so does the rest of the
+       chain.  Raising a blocked holder's priority also moves it
+       up in its lock's waiters, so each lock's donation stays
+       current. */
+    for (l = lock; l != NULL && l->holder != NULL; l = l->holder->waiting_lock) {
+      if (l->holder->effective_priority >= priority)
+        break;
+      thread_set_effective_priority(l->holder, priority);
     }
   }
 
   sema_down(&lock->semaphore);
-
-  /* starts from now, current thread is the new lock holder */
-  /* Add waiters of the lock to the donors list of the current thread */
-  struct list_elem* e;
-  for (e = list_begin(&lock->semaphore.waiters); e != list_end(&lock->semaphore.waiters);
-       e = list_next(e)) {
-    struct thread* t = list_entry(e, struct thread, elem);
-    list_push_back(&current_thread->donors, &t->donor_elem);
+  current_thread->waiting_lock = NULL;
+  lock_take(lock);
+  if (start != 0) {
+    uint64_t wait = timer_tsc() - start;
+    current_thread->usage.lock_wait_us += timer_tsc_to_us(wait);
+    if (lock_profiling) {
+      lock->class->contended++;
+      lock->class->wait_cycles += wait;
+      if (wait > lock->class->max_wait_cycles)
+        lock->class->max_wait_cycles = wait;
+    }
   }
 
-  lock->holder = thread_current();
-
   intr_set_level(old_level);
 }
 
@@ -235,14 +358,17 @@ void lock_acquire(struct lock* lock) {
    This function will not sleep, so it may be called within an
    interrupt handler. */
 bool lock_try_acquire(struct lock* lock) {
+  enum intr_level old_level;
   bool success;
 
   ASSERT(lock != NULL);
   ASSERT(!lock_held_by_current_thread(lock));
 
+  old_level = intr_disable();
   success = sema_try_down(&lock->semaphore);
   if (success)
-    lock->holder = thread_current();
+    lock_take(lock);
+  intr_set_level(old_level);
   return success;
 }
 
@@ -255,38 +381,20 @@ void lock_release(struct lock* lock) {
   ASSERT(lock_held_by_current_thread(lock));
 
   /* Project 2 */
-  struct list_elem* e;
-
   struct thread* curr_thread = thread_current();
   enum intr_level old_level = intr_disable();
 
-  /* Remove all threads waiting for this lock from current thread's donors list. */
-  for (e = list_begin(&(lock->semaphore).waiters); e != list_end(&(lock->semaphore).waiters);
-       e = list_next(e)) {
-    struct thread* t = list_entry(e, struct thread, elem);
-    list_remove(&t->donor_elem);
-  }
-
-  /* Find the highest priority from the rest of the thread's donors. */
-  int p_max = curr_thread->priority;
-  if (!list_empty(&curr_thread->donors)) {
-    for (e = list_begin(&curr_thread->donors); e != list_end(&curr_thread->donors);
-         e = list_next(e)) {
-      struct thread* t = list_entry(e, struct thread, donor_elem);
-      if (t->effective_priority > p_max) {
-        p_max = t->effective_priority;
-      }
-    }
-  }
-
-  curr_thread->effective_priority = p_max;
+  list_remove(&lock->elem);
   lock->holder = NULL;
+  if (lock_profiling)
+    lock->class->hold_cycles += timer_tsc() - lock->acquired;
+
+  /* Give up whatever LOCK's waiters donated. */
+  if (!thread_mlfqs)
+    thread_set_effective_priority(curr_thread, synch_effective_priority(curr_thread));
 
   intr_set_level(old_level);
   sema_up(&lock->semaphore);
-
-  /* Project 2 */
-  //check_thread_yield();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -298,27 +406,42 @@ bool lock_held_by_current_thread(const struct lock* lock) {
   return lock->holder == thread_current();
 }
 
-/* One semaphore in a list. */
-struct semaphore_elem {
-  struct list_elem elem;      /* List element. */
-  struct semaphore semaphore; /* This semaphore. */
-};
+/* Returns true if lock class A has waited less than lock class B
+   in total. */
+static bool less_wait(const struct list_elem* a_, const struct list_elem* b_, void* aux UNUSED) {
+  const struct lock_class* a = list_entry(a_, struct lock_class, elem);
+  const struct lock_class* b = list_entry(b_, struct lock_class, elem);
+  return a->wait_cycles < b->wait_cycles;
+}
 
-/* Compare the highest effective_priorities of two threads
-   Return True if highest effective_priority of elem1 is smaller. */
-bool cond_priority_comp(const struct list_elem* elem1, const struct list_elem* elem2, void* aux) {
-  struct semaphore_elem* sema1 = list_entry(elem1, struct semaphore_elem, elem);
-  struct semaphore_elem* sema2 = list_entry(elem2, struct semaphore_elem, elem);
+/* Prints contention statistics for every lock class that has
+   been acquired, most total waiting first, if lock profiling is
+   enabled. */
+void lock_print_stats(void) {
+  enum intr_level old_level;
+  struct list_elem* e;
+
+  if (!lock_profiling)
+    return;
 
-  ASSERT(!list_empty(&(sema1->semaphore).waiters));
-  ASSERT(!list_empty(&(sema2->semaphore).waiters));
-  struct list_elem* t1 = list_max(&(sema1->semaphore).waiters, comp_sema_priority, (void*)NULL);
-  struct list_elem* t2 = list_max(&(sema2->semaphore).waiters, comp_sema_priority, (void*)NULL);
+  /* New classes are only ever appended, so the list can be
+     walked with interrupts on once it is sorted. */
+  old_level = intr_disable();
+  list_sort(&lock_classes, less_wait, NULL);
+  list_reverse(&lock_classes);
+  intr_set_level(old_level);
 
-  int p1 = list_entry(t1, struct thread, elem)->effective_priority;
-  int p2 = list_entry(t2, struct thread, elem)->effective_priority;
+  printf("Locks: acquired/contended, wait total/max us, hold total us:\n");
+  for (e = list_begin(&lock_classes); e != list_end(&lock_classes); e = list_next(e)) {
+    const struct lock_class* c = list_entry(e, struct lock_class, elem);
+    const char* file = strrchr(c->file, '/');
 
-  return p1 < p2;
+    if (c->acquisitions == 0)
+      continue;
+    printf("  %s (%s:%d): %llu/%llu, %llu/%llu, %llu\n", c->name, file != NULL ? file + 1 : c->file,
+           c->line, c->acquisitions, c->contended, timer_tsc_to_us(c->wait_cycles),
+           timer_tsc_to_us(c->max_wait_cycles), timer_tsc_to_us(c->hold_cycles));
+  }
 }
 
 /* Initializes condition variable COND.  A condition variable
@@ -327,7 +450,7 @@ bool cond_priority_comp(const struct list_elem* elem1, const struct list_elem* e
 void cond_init(struct condition* cond) {
   ASSERT(cond != NULL);
 
-  list_init(&cond->waiters);
+  list_init(&cond->waiters); /* Highest priority first. */
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -349,6 +472,7 @@ void cond_init(struct condition* cond) {
    we need to sleep. */
 void cond_wait(struct condition* cond, struct lock* lock) {
   struct semaphore_elem waiter;
+  enum intr_level old_level;
 
   ASSERT(cond != NULL);
   ASSERT(lock != NULL);
@@ -356,7 +480,16 @@ void cond_wait(struct condition* cond, struct lock* lock) {
   ASSERT(lock_held_by_current_thread(lock));
 
   sema_init(&waiter.semaphore, 0);
-  list_push_back(&cond->waiters, &waiter.elem);
+  waiter.thread = thread_current();
+
+  /* Priority donation may reorder COND's waiters without holding
+     LOCK, so they are only touched with interrupts off. */
+  old_level = intr_disable();
+  insert_waiter(&cond->waiters, &waiter.elem, comp_cond_priority);
+  waiter.thread->wait_cond = cond;
+  waiter.thread->cond_elem = &waiter.elem;
+  intr_set_level(old_level);
+
   lock_release(lock);
   sema_down(&waiter.semaphore);
   lock_acquire(lock);
@@ -377,10 +510,11 @@ void cond_signal(struct condition* cond, struct lock* lock UNUSED) {
   if (!list_empty(&cond->waiters)) {
     /* Project 2 */
     enum intr_level old_level = intr_disable();
-    /* pick the thread with the highest effective priority amongst all waiters of the cond */
-    struct list_elem* t = list_max(&cond->waiters, cond_priority_comp, (void*)NULL);
-    sema_up(&list_entry(t, struct semaphore_elem, elem)->semaphore);
-    list_remove(t);
+    /* The waiters are kept highest priority first. */
+    struct semaphore_elem* waiter =
+        list_entry(list_pop_front(&cond->waiters), struct semaphore_elem, elem);
+    waiter->thread->wait_cond = NULL;
+    sema_up(&waiter->semaphore);
     intr_set_level(old_level);
   }
 }
@@ -397,3 +531,79 @@ void cond_broadcast(struct condition* cond, struct lock* lock) {
   while (!list_empty(&cond->waiters))
     cond_signal(cond, lock);
 }
+
+/* Initializes spin lock LOCK, named NAME, as free. */
+void spinlock_init(struct spinlock* lock, const char* name) {
+  ASSERT(lock != NULL);
+
+  lock->locked = 0;
+  lock->name = name;
+  lock->cpu = NULL;
+}
+
+/* Atomically sets *P to 1 and returns its old value. */
+static inline uint32_t test_and_set(volatile uint32_t* p) {
+  uint32_t old = 1;
+  asm volatile("xchgl %0, %1" : "+r"(old), "+m"(*p) : : "memory");
+  return old;
+}
+
+/* Acquires LOCK, spinning until it is free.  Interrupts must be
+   off, and LOCK must not already be held by this CPU, or it
+   would spin forever. */
+void spin_lock(struct spinlock* lock) {
+  ASSERT(lock != NULL);
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(!spin_lock_held(lock));
+
+  while (test_and_set(&lock->locked) != 0) {
+    /* Wait with plain reads, which stay in this CPU's cache,
+       until the lock looks free, and only then retry the
+       locked exchange. */
+    while (lock->locked != 0)
+      asm volatile("pause" : : : "memory");
+  }
+  lock->cpu = cpu_current();
+}
+
+/* Tries to acquire LOCK without spinning and returns true if
+   successful.  Interrupts must be off. */
+bool spin_try_lock(struct spinlock* lock) {
+  ASSERT(lock != NULL);
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (test_and_set(&lock->locked) != 0)
+    return false;
+  lock->cpu = cpu_current();
+  return true;
+}
+
+/* Releases LOCK, which must be held by this CPU. */
+void spin_unlock(struct spinlock* lock) {
+  ASSERT(spin_lock_held(lock));
+
+  lock->cpu = NULL;
+  barrier();
+  lock->locked = 0;
+}
+
+/* Returns true if this CPU holds LOCK, false otherwise. */
+bool spin_lock_held(const struct spinlock* lock) {
+  ASSERT(lock != NULL);
+
+  return lock->locked != 0 && lock->cpu == cpu_current();
+}
+
+/* Disables interrupts, acquires LOCK, and returns the previous
+   interrupt level, to be passed to spin_unlock_irqrestore(). */
+enum intr_level spin_lock_irqsave(struct spinlock* lock) {
+  enum intr_level old_level = intr_disable();
+  spin_lock(lock);
+  return old_level;
+}
+
+/* Releases LOCK and restores interrupt level OLD_LEVEL. */
+void spin_unlock_irqrestore(struct spinlock* lock, enum intr_level old_level) {
+  spin_unlock(lock);
+  intr_set_level(old_level);
+}
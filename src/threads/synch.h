@@ -3,11 +3,16 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+
+struct cpu;
+struct thread;
 
 /* A counting semaphore. */
 struct semaphore {
   unsigned value;      /* Current value. */
-  struct list waiters; /* List of waiting threads. */
+  struct list waiters; /* List of waiting threads, highest priority first. */
 };
 
 bool comp_sema_priority(const struct list_elem* elem1, const struct list_elem* elem2, void* aux);
@@ -17,21 +22,54 @@ bool sema_try_down(struct semaphore*);
 void sema_up(struct semaphore*);
 void sema_self_test(void);
 
+/* Contention statistics shared by every lock initialized at one
+   place in the source, kept while lock_profiling is true.  Times
+   are in time-stamp counter cycles. */
+struct lock_class {
+  const char* name;         /* Expression passed to lock_init(). */
+  const char* file;         /* Source file of the lock_init() call. */
+  int line;                 /* Line of the lock_init() call. */
+  bool registered;          /* In the list of all lock classes? */
+  struct list_elem elem;    /* Element in the list of all lock classes. */
+  uint64_t acquisitions;    /* Times acquired. */
+  uint64_t contended;       /* Times acquired after waiting. */
+  uint64_t wait_cycles;     /* Total time spent waiting. */
+  uint64_t max_wait_cycles; /* Longest single wait. */
+  uint64_t hold_cycles;     /* Total time held. */
+};
+
+/* If false (default), lock contention is not measured.
+   If true, set by kernel command-line option "-lockprof", it is
+   measured per lock class and reported at shutdown. */
+extern bool lock_profiling;
+
 /* Lock. */
 struct lock {
   struct thread* holder;      /* Thread holding lock (for debugging). */
   struct semaphore semaphore; /* Binary semaphore controlling access. */
+  struct list_elem elem;      /* Element in holder's held_locks. */
+  struct lock_class* class;   /* Contention statistics. */
+  uint64_t acquired;          /* Time-stamp counter when acquired. */
 };
 
-void lock_init(struct lock*);
+/* Initializes LOCK, which belongs to the lock class for this
+   line of source code. */
+#define lock_init(LOCK)                                                                            \
+  do {                                                                                             \
+    static struct lock_class lock_class_ = {.name = #LOCK, .file = __FILE__, .line = __LINE__}; \
+    lock_init_class(LOCK, &lock_class_);                                                           \
+  } while (0)
+
+void lock_init_class(struct lock*, struct lock_class*);
 void lock_acquire(struct lock*);
 bool lock_try_acquire(struct lock*);
 void lock_release(struct lock*);
 bool lock_held_by_current_thread(const struct lock*);
+void lock_print_stats(void);
 
 /* Condition variable. */
 struct condition {
-  struct list waiters; /* List of waiting threads. */
+  struct list waiters; /* List of semaphore_elems, highest priority first. */
 };
 
 bool comp_cond_priority(const struct list_elem* elem1, const struct list_elem* elem2, void* aux);
@@ -40,6 +78,32 @@ void cond_wait(struct condition*, struct lock*);
 void cond_signal(struct condition*, struct lock*);
 void cond_broadcast(struct condition*, struct lock*);
 
+/* Spin lock.
+
+   Protects data shared between CPUs for short stretches of code
+   that must not sleep, such as the run queues.  A spin lock is
+   only ever held with interrupts off, so that an interrupt
+   handler on the same CPU cannot spin forever on a lock that its
+   own CPU holds.  Locks, semaphores, and condition variables put
+   waiting threads to sleep instead, and should be preferred
+   everywhere else. */
+struct spinlock {
+  volatile uint32_t locked; /* 1 if held, 0 if free. */
+  const char* name;         /* Name (for debugging purposes). */
+  struct cpu* cpu;          /* CPU holding the lock (for debugging). */
+};
+
+void spinlock_init(struct spinlock*, const char* name);
+void spin_lock(struct spinlock*);
+bool spin_try_lock(struct spinlock*);
+void spin_unlock(struct spinlock*);
+bool spin_lock_held(const struct spinlock*);
+enum intr_level spin_lock_irqsave(struct spinlock*);
+void spin_unlock_irqrestore(struct spinlock*, enum intr_level);
+
+void synch_requeue(struct thread*);
+int synch_effective_priority(struct thread*);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
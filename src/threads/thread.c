@@ -1,9 +1,12 @@
 #include "threads/thread.h"
 #include <debug.h>
+#include <limits.h>
 #include <stddef.h>
 #include <random.h>
+#include <schedtrace.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
@@ -12,6 +15,7 @@
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -21,20 +25,23 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-/* Idle thread. */
-static struct thread* idle_thread;
-
 /* Initial thread, the thread running init.c:main(). */
 static struct thread* initial_thread;
 
+/* Pages of threads that have died, kept for reuse by
+   thread_create() so that creating a thread usually avoids the
+   page allocator's lock, its bitmap scan, and zeroing a whole
+   page.  Each page links to the next through its first word.
+   At most THREAD_PAGE_CACHE_MAX pages are kept; the rest go back
+   to the page allocator.  Accessed only with interrupts off. */
+#define THREAD_PAGE_CACHE_MAX 16
+static void* thread_page_cache;
+static size_t thread_page_cache_cnt;
+
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
@@ -51,14 +58,47 @@ static long long kernel_ticks; /* # of timer ticks in kernel threads. */
 static long long user_ticks;   /* # of timer ticks in user programs. */
 
 /* Scheduling. */
-#define TIME_SLICE 4          /* # of timer ticks to give each thread. */
-static unsigned thread_ticks; /* # of timer ticks since last yield. */
+#define TIME_SLICE 4          /* Default # of timer ticks to give each thread. */
+
+/* Number of timer ticks to give each thread, or, if
+   thread_slice_scaled, each thread of priority PRI_DEFAULT.
+   Controlled by kernel command-line option "-slice=N". */
+unsigned thread_time_slice = TIME_SLICE;
+
+/* If false (default), every thread gets thread_time_slice ticks.
+   If true, set by kernel command-line option "-slice-scale", the
+   slice doubles for every SLICE_SCALE_STEP priority levels below
+   PRI_DEFAULT and halves, down to one tick, for every
+   SLICE_SCALE_STEP levels above it, so that low-priority batch
+   threads switch less often and high-priority threads take turns
+   sooner. */
+bool thread_slice_scaled;
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If false (default), scheduler events are not recorded.
+   If true, set by kernel command-line option "-schedtrace", the
+   most recent SCHEDTRACE_SIZE of them are kept in trace_ring,
+   where thread_trace_read() can fetch them, and are printed at
+   shutdown. */
+bool thread_trace;
+
+/* Scheduler event ring buffer.  Event number N, counting from 0
+   at boot, is kept in trace_ring[N % SCHEDTRACE_SIZE] until it is
+   overwritten.  Accessed only with interrupts off. */
+static struct schedtrace_event trace_ring[SCHEDTRACE_SIZE];
+static uint64_t trace_cnt; /* Events recorded since boot. */
+
+/* MLFQS: The system load average. */
+static fixed_point_t load_avg;
+
+/* MLFQS: Ticks between recomputations of the running thread's
+   priority. */
+#define PRIORITY_INTERVAL 4
+
 static void kernel_thread(thread_func*, void* aux);
 
 static void idle(void* aux UNUSED);
@@ -66,16 +106,31 @@ static struct thread* running_thread(void);
 static struct thread* next_thread_to_run(void);
 static void init_thread(struct thread*, const char* name, int priority);
 static bool is_thread(struct thread*) UNUSED;
+static bool is_idle(const struct thread*);
 static void* alloc_frame(struct thread*, size_t size);
+static struct thread* thread_page_get(void);
+static void thread_page_put(struct thread*);
 static void schedule(void);
 void thread_schedule_tail(struct thread* prev);
 static tid_t allocate_tid(void);
+static void ready_queue_push(struct thread*);
+static void ready_queue_remove(struct thread*);
+static int ready_queue_max_priority(const struct runqueue*);
+static struct thread* ready_queue_pop(struct runqueue*);
+static struct thread* steal_thread(struct cpu*);
+static int ready_thread_cnt(void);
+static unsigned time_slice(const struct thread*);
+static void mlfqs_tick(struct cpu*, struct thread*);
+static void trace(enum schedtrace_type, struct thread*, tid_t other, enum thread_status from);
+static void mlfqs_update_priority(struct thread*, void* aux);
+static void mlfqs_update_recent_cpu(struct thread*, void* aux);
+static void mlfqs_count_running(struct thread*, void* aux);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
    general and it is possible in this case only because loader.S
    was careful to put the bottom of the stack at a page boundary.
-   Also initializes the run queue and the tid lock.
+   Also initializes the run queues and the tid lock.
    After calling this function, be sure to initialize the page
    allocator before trying to create any threads with
    thread_create().
@@ -83,9 +138,11 @@ static tid_t allocate_tid(void);
    finishes. */
 void thread_init(void) {
   ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(PRI_MAX - PRI_MIN + 1 <= 64);
 
   lock_init(&tid_lock);
-  list_init(&ready_list);
+  cpu_init();
+  load_avg = fix_int(0);
   list_init(&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -106,34 +163,160 @@ void thread_start(void) {
   /* Start preemptive thread scheduling. */
   intr_enable();
 
-  /* Wait for the idle thread to initialize idle_thread. */
+  /* Wait for the idle thread to initialize itself. */
   sema_down(&idle_started);
 }
 
-/* Called by the timer interrupt handler at each timer tick.
+/* Creates the idle thread for CPU C, other than the bootstrap
+   processor, for cpu_start() to start C on.  Returns the new
+   thread, or a null pointer if memory is not available. */
+struct thread* thread_create_idle(struct cpu* c) {
+  struct thread* t = palloc_get_page(0);
+
+  if (t == NULL)
+    return NULL;
+  init_thread(t, "idle", PRI_MIN);
+  t->tid = allocate_tid();
+  t->cpu = c;
+  c->idle = t;
+  return t;
+}
+
+/* Turns the code running on a CPU other than the bootstrap
+   processor, on the stack of the idle thread that
+   thread_create_idle() created for it, into that thread.
+   Interrupts must be off. */
+void thread_init_ap(void) {
+  struct thread* t = running_thread();
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(t == cpu_current()->idle);
+
+  t->status = THREAD_RUNNING;
+}
+
+/* Runs the idle thread of a CPU other than the bootstrap
+   processor, after thread_init_ap(), so that the CPU starts
+   taking threads from the other CPUs. */
+void thread_start_ap(void) {
+  idle(NULL);
+  NOT_REACHED();
+}
+
+/* Called by the timer interrupt handler at each timer tick, with
+   USER true if the tick interrupted user code.
    Thus, this function runs in an external interrupt context. */
-void thread_tick(void) {
+void thread_tick(bool user) {
+  struct cpu* c = cpu_current();
   struct thread* t = thread_current();
+  int ready_max;
 
   /* Update statistics. */
-  if (t == idle_thread)
+  c->ticks++;
+  if (is_idle(t))
     idle_ticks++;
+  else {
+    if (user)
+      t->usage.user_ticks++;
+    else
+      t->usage.kernel_ticks++;
 #ifdef USERPROG
-  else if (t->pagedir != NULL)
-    user_ticks++;
+    if (t->pagedir != NULL)
+      user_ticks++;
+    else
 #endif
-  else
-    kernel_ticks++;
+      kernel_ticks++;
+  }
+
+  if (thread_mlfqs)
+    mlfqs_tick(c, t);
 
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  /* Enforce preemption, both at the end of the time slice and
+     as soon as a higher-priority thread is ready, so that long
+     slices for low priorities do not delay more urgent work. */
+  ready_max = ready_queue_max_priority(&c->rq);
+  if (++c->slice_ticks >= time_slice(t) || ready_max > t->effective_priority)
     intr_yield_on_return();
 }
 
+/* Returns the number of timer ticks that T may run before it is
+   preempted in favor of a thread of equal priority. */
+static unsigned time_slice(const struct thread* t) {
+  int steps;
+
+  if (!thread_slice_scaled)
+    return thread_time_slice;
+
+  steps = (PRI_DEFAULT - t->effective_priority) / SLICE_SCALE_STEP;
+  if (steps >= 0)
+    return steps < 32 && thread_time_slice <= UINT_MAX >> steps ? thread_time_slice << steps
+                                                                 : UINT_MAX;
+  else if (-steps < 32 && thread_time_slice >> -steps > 0)
+    return thread_time_slice >> -steps;
+  else
+    return 1;
+}
+
 /* Prints thread statistics. */
 void thread_print_stats(void) {
   printf("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n", idle_ticks, kernel_ticks,
          user_ticks);
+  if (thread_trace)
+    thread_trace_dump();
+}
+
+/* Records an event of the given TYPE about thread T, which was
+   in state FROM and is now in its current state, involving thread
+   OTHER, if not -1.  Does nothing unless tracing is enabled.
+   Interrupts must be off. */
+static void trace(enum schedtrace_type type, struct thread* t, tid_t other,
+                  enum thread_status from) {
+  struct schedtrace_event* e;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (!thread_trace)
+    return;
+
+  e = &trace_ring[trace_cnt++ % SCHEDTRACE_SIZE];
+  e->tick = timer_ticks();
+  e->tsc = timer_tsc();
+  e->tid = t->tid;
+  e->other = other;
+  e->type = type;
+  e->from = from;
+  e->to = t->status;
+  e->priority = t->effective_priority;
+}
+
+/* Copies up to MAX of the most recent scheduler events into
+   EVENTS, oldest first, and returns the number copied. */
+size_t thread_trace_read(struct schedtrace_event* events, size_t max) {
+  enum intr_level old_level = intr_disable();
+  uint64_t first, i;
+
+  first = trace_cnt > SCHEDTRACE_SIZE ? trace_cnt - SCHEDTRACE_SIZE : 0;
+  if (trace_cnt - first > max)
+    first = trace_cnt - max;
+  for (i = first; i < trace_cnt; i++)
+    events[i - first] = trace_ring[i % SCHEDTRACE_SIZE];
+  intr_set_level(old_level);
+
+  return i - first;
+}
+
+/* Prints the scheduler events still in the ring buffer, oldest
+   first, in the format that utils/pintos-schedtrace reads. */
+void thread_trace_dump(void) {
+  uint64_t first = trace_cnt > SCHEDTRACE_SIZE ? trace_cnt - SCHEDTRACE_SIZE : 0;
+  uint64_t i;
+
+  printf("schedtrace: %llu events, %llu dropped\n", trace_cnt - first, first);
+  for (i = first; i < trace_cnt; i++) {
+    const struct schedtrace_event* e = &trace_ring[i % SCHEDTRACE_SIZE];
+    printf("schedtrace: %lld %llu %d %d %u %u %u %u\n", e->tick, e->tsc, e->tid, e->other, e->type,
+           e->from, e->to, e->priority);
+  }
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -158,8 +341,11 @@ tid_t thread_create(const char* name, int priority, thread_func* function, void*
 
   ASSERT(function != NULL);
 
-  /* Allocate thread. */
-  t = palloc_get_page(PAL_ZERO);
+  /* Allocate thread.  The page need not be zeroed: init_thread()
+     clears struct thread and alloc_frame() clears each stack frame
+     as it is carved out, and nothing reads the stack before it is
+     written. */
+  t = thread_page_get();
   if (t == NULL)
     return TID_ERROR;
 
@@ -168,7 +354,7 @@ tid_t thread_create(const char* name, int priority, thread_func* function, void*
   tid = t->tid = allocate_tid();
 
 #ifdef USERPROG
-  struct wait_info* wait_info = malloc(sizeof(struct wait_info));
+  struct wait_info* wait_info = slab_alloc(&wait_info_cache);
   sema_init(&(wait_info->sema), 0);
   lock_init(&(wait_info->lock));
   wait_info->tid = t->tid;
@@ -221,6 +407,7 @@ void thread_block(void) {
   ASSERT(intr_get_level() == INTR_OFF);
 
   thread_current()->status = THREAD_BLOCKED;
+  trace(SCHEDTRACE_BLOCK, thread_current(), -1, THREAD_RUNNING);
   schedule();
 }
 
@@ -238,8 +425,11 @@ void thread_unblock(struct thread* t) {
 
   old_level = intr_disable();
   ASSERT(t->status == THREAD_BLOCKED);
-  list_push_back(&ready_list, &t->elem);
+  ready_queue_push(t);
   t->status = THREAD_READY;
+  trace(SCHEDTRACE_UNBLOCK, t, running_thread()->tid, THREAD_BLOCKED);
+  if (t->cpu != cpu_current())
+    cpu_kick(t->cpu);
   intr_set_level(old_level);
 }
 
@@ -274,6 +464,7 @@ void thread_exit(void) {
 #ifdef USERPROG
   process_exit();
 #endif
+  malloc_thread_exit();
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
@@ -294,8 +485,8 @@ void thread_yield(void) {
   ASSERT(!intr_context());
 
   old_level = intr_disable();
-  if (cur != idle_thread)
-    list_push_back(&ready_list, &cur->elem);
+  if (!is_idle(cur))
+    ready_queue_push(cur);
   cur->status = THREAD_READY;
   schedule();
   intr_set_level(old_level);
@@ -318,32 +509,20 @@ void thread_foreach(thread_action_func* func, void* aux) {
 void thread_set_priority(int new_priority) {
   struct thread* current_thread = thread_current();
 
+  /* The MLFQS scheduler computes priorities itself. */
+  if (thread_mlfqs)
+    return;
+
   enum intr_level old_level = intr_disable();
 
-  int old_base_priority = current_thread->priority;
   int old_effect_priority = current_thread->effective_priority;
   current_thread->priority = new_priority;
 
-  if (new_priority >= old_effect_priority) {
-    current_thread->effective_priority = new_priority;
-  } else if (new_priority < old_effect_priority && old_base_priority == old_effect_priority) {
-    int highest_prio = new_priority;
-    if (!list_empty(&current_thread->donors)) {
-      struct list_elem* e;
-
-      for (e = list_begin(&current_thread->donors); e != list_end(&current_thread->donors);
-           e = list_next(e)) {
-        struct thread* t = list_entry(e, struct thread, donor_elem);
-        if (t->effective_priority > highest_prio) {
-          highest_prio = t->effective_priority;
-        }
-      }
-    }
-    current_thread->effective_priority = highest_prio;
-    if (highest_prio < old_effect_priority) {
-      check_thread_yield();
-    }
-  }
+  /* Donations through held locks still apply on top of the new
+     base priority. */
+  thread_set_effective_priority(current_thread, synch_effective_priority(current_thread));
+  if (current_thread->effective_priority < old_effect_priority)
+    check_thread_yield();
 
   intr_set_level(old_level);
 }
@@ -351,57 +530,150 @@ void thread_set_priority(int new_priority) {
 /* Returns the current thread's priority. */
 int thread_get_priority(void) { return thread_current()->effective_priority; }
 
-/* Sets the current thread's nice value to NICE. */
-void thread_set_nice(int nice UNUSED) { /* Not yet implemented. */
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority, and yields if it no longer has the highest priority. */
+void thread_set_nice(int nice) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+
+  ASSERT(NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable();
+  cur->nice = nice;
+  if (thread_mlfqs) {
+    mlfqs_update_priority(cur, NULL);
+    check_thread_yield();
+  }
+  intr_set_level(old_level);
 }
 
 /* Returns the current thread's nice value. */
-int thread_get_nice(void) {
-  /* Not yet implemented. */
-  return 0;
-}
+int thread_get_nice(void) { return thread_current()->nice; }
 
 /* Returns 100 times the system load average. */
 int thread_get_load_avg(void) {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable();
+  int load = fix_round(fix_scale(load_avg, 100));
+  intr_set_level(old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int thread_get_recent_cpu(void) {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable();
+  int recent = fix_round(fix_scale(thread_current()->recent_cpu, 100));
+  intr_set_level(old_level);
+  return recent;
+}
+
+/* MLFQS: Returns the priority that T's nice and recent_cpu call
+   for. */
+static int mlfqs_priority(const struct thread* t) {
+  int priority = PRI_MAX - fix_trunc(fix_unscale(t->recent_cpu, 4)) - t->nice * 2;
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  return priority;
+}
+
+/* MLFQS: Recomputes T's priority, moving T to the ready queue for
+   its new priority if it is ready. */
+static void mlfqs_update_priority(struct thread* t, void* aux UNUSED) {
+  if (is_idle(t))
+    return;
+  t->priority = mlfqs_priority(t);
+  thread_set_effective_priority(t, t->priority);
+}
+
+/* MLFQS: Decays T's recent_cpu by the load average, as done once
+   per second. */
+static void mlfqs_update_recent_cpu(struct thread* t, void* aux UNUSED) {
+  fixed_point_t twice_load = fix_scale(load_avg, 2);
+  fixed_point_t decay = fix_div(twice_load, fix_add(twice_load, fix_int(1)));
+
+  if (is_idle(t))
+    return;
+  t->recent_cpu = fix_add(fix_mul(decay, t->recent_cpu), fix_int(t->nice));
+}
+
+/* MLFQS: Adds running thread T to the count that CNT_ points
+   to, unless T is an idle thread. */
+static void mlfqs_count_running(struct thread* t, void* cnt_) {
+  int* cnt = cnt_;
+  if (t->status == THREAD_RUNNING && !is_idle(t))
+    (*cnt)++;
+}
+
+/* MLFQS: Per-tick accounting for thread T, running on CPU C,
+   called with interrupts off from thread_tick().
+
+   Only the running thread's recent_cpu changes from one tick to
+   the next, so every PRIORITY_INTERVAL of its CPU's ticks only
+   its priority needs recomputing.  Once per second the load
+   average and every thread's recent_cpu are updated, and with
+   them every thread's priority, by the bootstrap processor, whose
+   ticks are the timer's.  Priority changes move ready threads
+   between ready queues in constant time, so no list is ever
+   re-sorted. */
+static void mlfqs_tick(struct cpu* c, struct thread* t) {
+  if (!is_idle(t))
+    t->recent_cpu = fix_add(t->recent_cpu, fix_int(1));
+
+  if (c->bsp && c->ticks % TIMER_FREQ == 0) {
+    /* Count the threads running on every CPU, not just this one. */
+    int ready_threads = ready_thread_cnt();
+    thread_foreach(mlfqs_count_running, &ready_threads);
+    load_avg =
+        fix_add(fix_mul(fix_frac(59, 60), load_avg), fix_scale(fix_frac(1, 60), ready_threads));
+    thread_foreach(mlfqs_update_recent_cpu, NULL);
+    thread_foreach(mlfqs_update_priority, NULL);
+    check_thread_yield();
+  } else if (c->ticks % PRIORITY_INTERVAL == 0) {
+    mlfqs_update_priority(t, NULL);
+    check_thread_yield();
+  }
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
-   The idle thread is initially put on the ready list by
-   thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
-   to it to enable thread_start() to continue, and immediately
-   blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
-static void idle(void* idle_started_ UNUSED) {
+   Each CPU has one.  The bootstrap processor's idle thread is
+   initially put on the ready list by thread_start().  It will be
+   scheduled once initially, at which point it records itself as
+   its CPU's idle thread, "up"s the semaphore passed to it to
+   enable thread_start() to continue, and immediately blocks.
+   Other CPUs' idle threads start out running, with a null
+   IDLE_STARTED (see thread_start_ap()).  After that, the idle
+   thread never appears in the ready list.  It is returned by
+   next_thread_to_run() as a special case when the ready list is
+   empty and there is nothing to steal. */
+static void idle(void* idle_started_) {
   struct semaphore* idle_started = idle_started_;
-  idle_thread = thread_current();
-  sema_up(idle_started);
+  cpu_current()->idle = thread_current();
+  if (idle_started != NULL)
+    sema_up(idle_started);
 
   for (;;) {
     /* Let someone else run. */
     intr_disable();
     thread_block();
 
+    /* Zero free pages for later PAL_ZERO allocations, one at a
+       time, until there are enough or another thread becomes
+       ready on any CPU.  If one did, run or steal it instead of
+       halting. */
+    intr_enable();
+    while (ready_thread_cnt() == 0 && palloc_zero_idle())
+      continue;
+    intr_disable();
+    if (ready_thread_cnt() > 0)
+      continue;
+
     /* Re-enable interrupts and wait for the next one.
-         The `sti' instruction disables interrupts until the
-         completion of the next instruction, so these two
-         instructions are executed atomically.  This atomicity is
-         important; otherwise, an interrupt could be handled
-         between re-enabling interrupts and waiting for the next
-         one to occur, wasting as much as one clock tick worth of
-         time.
-         See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-         7.11.1 "HLT Instruction". */
-    asm volatile("sti; hlt" : : : "memory");
+
+       In tickless mode, first arrange for the next timer
+       interrupt to come no sooner than it is needed. */
+    timer_idle();
+    intr_wait();
   }
 }
 
@@ -429,6 +701,10 @@ struct thread* running_thread(void) {
 /* Returns true if T appears to point to a valid thread. */
 static bool is_thread(struct thread* t) { return t != NULL && t->magic == THREAD_MAGIC; }
 
+/* Returns true if T is a CPU's idle thread.  An idle thread
+   never leaves its CPU. */
+static bool is_idle(const struct thread* t) { return t == t->cpu->idle; }
+
 /* Does basic initialization of T as a blocked thread named
    NAME. */
 static void init_thread(struct thread* t, const char* name, int priority) {
@@ -444,8 +720,22 @@ static void init_thread(struct thread* t, const char* name, int priority) {
   t->stack = (uint8_t*)t + PGSIZE;
   t->priority = priority;
   t->effective_priority = priority;
+  t->cpu = cpu_current();
   t->magic = THREAD_MAGIC;
 
+  /* Under MLFQS, a new thread inherits its creator's niceness and
+     recent CPU use, and its priority follows from them. */
+  t->nice = NICE_DEFAULT;
+  t->recent_cpu = fix_int(0);
+  if (thread_mlfqs) {
+    struct thread* parent = running_thread();
+    if (parent != t && is_thread(parent)) {
+      t->nice = parent->nice;
+      t->recent_cpu = parent->recent_cpu;
+    }
+    t->priority = t->effective_priority = mlfqs_priority(t);
+  }
+
 #ifdef USERPROG
   t->next_aval_fd = 2;
   list_init(&t->children_wait_info);
@@ -453,7 +743,7 @@ static void init_thread(struct thread* t, const char* name, int priority) {
   t->cur_file = NULL;
 #endif
 
-  list_init(&t->donors);
+  list_init(&t->held_locks);
 
   old_level = intr_disable();
   list_push_back(&all_list, &t->allelem);
@@ -468,28 +758,182 @@ static void* alloc_frame(struct thread* t, size_t size) {
   ASSERT(size % sizeof(uint32_t) == 0);
 
   t->stack -= size;
+  memset(t->stack, 0, size);
   return t->stack;
 }
 
+/* Returns a page for a new thread, from the cache of dead
+   threads' pages if possible, otherwise from the page allocator.
+   The page's contents are unspecified.  Returns a null pointer if
+   no page is available. */
+static struct thread* thread_page_get(void) {
+  enum intr_level old_level = intr_disable();
+  void* page = thread_page_cache;
+  if (page != NULL) {
+    thread_page_cache = *(void**)page;
+    thread_page_cache_cnt--;
+  }
+  intr_set_level(old_level);
+
+  return page != NULL ? page : palloc_get_page(0);
+}
+
+/* Releases the page of dead thread T, keeping it in the cache if
+   there is room.  Interrupts must be off. */
+static void thread_page_put(struct thread* t) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  /* Keep is_thread() from accepting a stale pointer to T. */
+  t->magic = 0;
+
+  if (thread_page_cache_cnt < THREAD_PAGE_CACHE_MAX) {
+    *(void**)t = thread_page_cache;
+    thread_page_cache = t;
+    thread_page_cache_cnt++;
+  } else
+    palloc_free_page(t);
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
-   empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   return a thread from this CPU's run queue, unless the run
+   queue is empty.  (If the running thread can continue running,
+   then it will be in the run queue.)  If the run queue is empty,
+   steals a thread from another CPU's run queue, and if there is
+   none to steal, returns the CPU's idle thread. */
 static struct thread* next_thread_to_run(void) {
-  if (list_empty(&ready_list)) {
-    return idle_thread;
+  struct cpu* c = cpu_current();
+  struct thread* t = ready_queue_pop(&c->rq);
+
+  if (t == NULL)
+    t = steal_thread(c);
+  return t != NULL ? t : c->idle;
+}
+
+/* Removes and returns the highest-priority thread in RQ, or a
+   null pointer if RQ is empty.  Interrupts must be off. */
+static struct thread* ready_queue_pop(struct runqueue* rq) {
+  struct thread* t = NULL;
+  int priority;
+
+  spin_lock(&rq->lock);
+  priority = ready_queue_max_priority(rq);
+  if (priority >= 0) {
+    t = list_entry(list_pop_front(&rq->queues[priority]), struct thread, elem);
+    rq->cnt--;
+    if (list_empty(&rq->queues[priority]))
+      rq->mask &= ~((uint64_t)1 << priority);
+  }
+  spin_unlock(&rq->lock);
+  return t;
+}
+
+/* Takes the highest-priority ready thread from the online CPU,
+   other than C, with the most ready threads, and moves it to C.
+   Returns the thread, or a null pointer if no other CPU has a
+   ready thread.  Interrupts must be off. */
+static struct thread* steal_thread(struct cpu* c) {
+  struct cpu* victim = NULL;
+  struct thread* t;
+  int i;
+
+  /* Reading another CPU's count without its lock is only a hint;
+     ready_queue_pop() copes if it has changed by the time we
+     get there. */
+  for (i = 0; i < cpu_cnt; i++)
+    if (&cpus[i] != c && cpus[i].online && cpus[i].rq.cnt > (victim ? victim->rq.cnt : 0))
+      victim = &cpus[i];
+  if (victim == NULL)
+    return NULL;
+
+  t = ready_queue_pop(&victim->rq);
+  if (t != NULL) {
+    t->cpu = c;
+    c->steals++;
+  }
+  return t;
+}
+
+/* Returns the number of threads ready to run on all CPUs,
+   excluding the running threads. */
+static int ready_thread_cnt(void) {
+  int cnt = 0;
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    cnt += cpus[i].rq.cnt;
+  return cnt;
+}
+
+/* Returns the index of the most significant set bit in X, which
+   must be nonzero. */
+static inline int highest_bit(uint32_t x) {
+  int bit;
+  asm("bsrl %1, %0" : "=r"(bit) : "rm"(x));
+  return bit;
+}
+
+/* Appends ready thread T to the ready queue for its effective
+   priority on the run queue of the CPU it last ran on.
+   Interrupts must be off. */
+static void ready_queue_push(struct thread* t) {
+  struct runqueue* rq = &t->cpu->rq;
+  int priority = t->effective_priority;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  spin_lock(&rq->lock);
+  list_push_back(&rq->queues[priority], &t->elem);
+  rq->mask |= (uint64_t)1 << priority;
+  rq->cnt++;
+  spin_unlock(&rq->lock);
+}
+
+/* Removes ready thread T from its ready queue.  Interrupts must
+   be off. */
+static void ready_queue_remove(struct thread* t) {
+  struct runqueue* rq = &t->cpu->rq;
+  int priority = t->effective_priority;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  spin_lock(&rq->lock);
+  list_remove(&t->elem);
+  rq->cnt--;
+  if (list_empty(&rq->queues[priority]))
+    rq->mask &= ~((uint64_t)1 << priority);
+  spin_unlock(&rq->lock);
+}
+
+/* Returns the highest effective priority of any thread ready in
+   RQ, or -1 if no thread is ready. */
+static int ready_queue_max_priority(const struct runqueue* rq) {
+  uint32_t high = rq->mask >> 32;
+  uint32_t low = rq->mask;
+
+  if (high != 0)
+    return 32 + highest_bit(high);
+  else if (low != 0)
+    return highest_bit(low);
+  else
+    return -1;
+}
+
+/* Sets T's effective priority to PRIORITY.  If T is ready, moves
+   it to the back of the ready queue for its new priority.
+   Interrupts must be off. */
+void thread_set_effective_priority(struct thread* t, int priority) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->effective_priority == priority)
+    return;
+  if (t->status == THREAD_READY) {
+    ready_queue_remove(t);
+    t->effective_priority = priority;
+    ready_queue_push(t);
   } else {
-    /* Project 2 */
-    enum intr_level old_level = intr_disable();
-    struct list_elem* t_elem = list_max(&ready_list, priority_comp, (void*)NULL);
-    list_remove(t_elem);
-    struct thread* next_thread = list_entry(t_elem, struct thread, elem);
-    intr_set_level(old_level);
-    return next_thread;
-
-    return list_entry(list_pop_front(&ready_list), struct thread, elem);
+    t->effective_priority = priority;
+    synch_requeue(t);
   }
+  trace(SCHEDTRACE_PRIORITY, t, running_thread()->tid, t->status);
 }
 
 /* Compare the effective_priority of the list_elems’ respective threads
@@ -503,13 +947,11 @@ bool priority_comp(const struct list_elem* elem1, const struct list_elem* elem2,
 /* After priority donation or other operations that might have changed thread priorities
    it examines whether the current thread still has the highest priority after changes  */
 void check_thread_yield(void) {
-  if (list_empty(&ready_list)) {
-    return;
-  }
+  enum intr_level old_level = intr_disable();
+  int highest_priority = ready_queue_max_priority(&cpu_current()->rq);
+  intr_set_level(old_level);
 
-  struct thread* highest_prio_thread =
-      list_entry(list_max(&ready_list, priority_comp, (void*)NULL), struct thread, elem);
-  if (thread_current()->effective_priority < highest_prio_thread->effective_priority) {
+  if (thread_current()->effective_priority < highest_priority) {
     if (!intr_context()) {
       thread_yield();
     } else {
@@ -540,7 +982,7 @@ void thread_schedule_tail(struct thread* prev) {
   cur->status = THREAD_RUNNING;
 
   /* Start new time slice. */
-  thread_ticks = 0;
+  cpu_current()->slice_ticks = 0;
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -554,7 +996,7 @@ void thread_schedule_tail(struct thread* prev) {
      palloc().) */
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) {
     ASSERT(prev != cur);
-    palloc_free_page(prev);
+    thread_page_put(prev);
   }
 }
 
@@ -573,11 +1015,31 @@ static void schedule(void) {
   ASSERT(cur->status != THREAD_RUNNING);
   ASSERT(is_thread(next));
 
-  if (cur != next)
+  if (cur != next) {
+    /* A thread that is still ready was preempted or yielded; one
+       that blocked or is dying gave up the CPU of its own accord. */
+    if (cur->status == THREAD_READY)
+      cur->usage.involuntary_switches++;
+    else
+      cur->usage.voluntary_switches++;
+    trace(SCHEDTRACE_SWITCH, cur, next->tid, THREAD_RUNNING);
+    next->cpu = cpu_current();
+    next->cpu->switches++;
     prev = switch_threads(cur, next);
+  }
   thread_schedule_tail(prev);
 }
 
+/* Adds the resource usage in B to A. */
+void rusage_add(struct rusage* a, const struct rusage* b) {
+  a->user_ticks += b->user_ticks;
+  a->kernel_ticks += b->kernel_ticks;
+  a->voluntary_switches += b->voluntary_switches;
+  a->involuntary_switches += b->involuntary_switches;
+  a->lock_wait_us += b->lock_wait_us;
+  a->io_wait_us += b->io_wait_us;
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t allocate_tid(void) {
   static tid_t next_tid = 1;
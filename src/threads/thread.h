@@ -3,9 +3,11 @@
 
 #include <debug.h>
 #include <list.h>
+#include <rusage.h>
 #include <stdint.h>
 #include "threads/synch.h"
 #include "threads/fixed-point.h"
+#include "threads/malloc.h"
 
 /* States in a thread's life cycle. */
 enum thread_status {
@@ -25,6 +27,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31 /* Default priority. */
 #define PRI_MAX 63     /* Highest priority. */
 
+/* Thread niceness, for the multi-level feedback queue scheduler. */
+#define NICE_MIN -20   /* Nicest. */
+#define NICE_DEFAULT 0 /* Default niceness. */
+#define NICE_MAX 20    /* Least nice. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -89,6 +96,7 @@ struct thread {
   uint8_t* stack;            /* Saved stack pointer. */
   int priority;              /* Priority. */
   struct list_elem allelem;  /* List element for all threads list. */
+  struct cpu* cpu;           /* CPU last run on, whose run queue holds us. */
 
 #ifdef USERPROG
   struct wait_info* wait_info;    /* wait_info struct for current thread. */
@@ -96,24 +104,39 @@ struct thread {
   struct list fdt;                /* Fd table, consist of a list of table entries. */
   int next_aval_fd;               /* Keeps track of the next available fd to assign. */
   struct file* cur_file;          /* record current file */
+  struct rusage child_usage;      /* Usage of exited children that were waited for. */
 #endif
 
+  struct rusage usage; /* Resource usage of this thread. */
+
+  /* Owned by threads/malloc.c. */
+  struct magazine magazines[MALLOC_DESC_CNT]; /* Free blocks, by size. */
+
   /* ================Project 2================ */
-  int64_t wakeup_tick;    /* Time to wake up. */
-  int effective_priority; /* The effective priority of the thread after donation */
-  struct thread* donee;   /* Pointer to the thread that current thread is waiting on.*/
-  struct list donors;     /* threads donating to this thread */
+  int effective_priority;    /* The effective priority of the thread after donation */
+  struct list held_locks;    /* Locks held, each donating its top waiter's priority. */
+  struct lock* waiting_lock; /* Lock this thread is waiting to acquire, if any. */
 
-  struct list_elem donor_elem; /* List element for donors list. */
-  struct list_elem sleepelem;  /* List element for sleep_list. */
+  struct semaphore* wait_sema; /* Semaphore this thread is queued on, if any. */
+  struct condition* wait_cond; /* Condition variable this thread waits on, if any. */
+  struct list_elem* cond_elem; /* Element in WAIT_COND's waiters. */
   /* ========================================= */
 
+  /* Owned by thread.c, used only by the MLFQS scheduler. */
+  int nice;                  /* Niceness. */
+  fixed_point_t recent_cpu;  /* Recent CPU use, decayed each second. */
+
   /* Shared between thread.c and synch.c. */
   struct list_elem elem; /* List element. */
 
 #ifdef USERPROG
   /* Owned by userprog/process.c. */
   uint32_t* pagedir; /* Page directory. */
+#ifdef VM
+  /* Owned by vm/page.c. */
+  struct hash* pages; /* Supplemental page table, or null. */
+  void* user_esp;     /* User stack pointer at last entry to the kernel. */
+#endif
   /* ================Project 3================ */
   struct dir* cwd; /* CWD of the process. */
   /* ========================================= */
@@ -132,6 +155,7 @@ struct wait_info {
   int exit_code;         // Pointer to the child’s exit_code.
   bool loaded;           // whether the child process have successfully loaded executable
   bool waited;           // whether the parent is has waited for the child
+  struct rusage usage;   // the child's resource usage, including its waited-for children
   tid_t tid;             // tid of the child thread
   struct list_elem elem; // for creating a list of children_wait_info
 };
@@ -150,12 +174,38 @@ struct fd_row {
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* Time slice, in timer ticks, and whether it is scaled by
+   priority.  Controlled by kernel command-line options "-slice=N"
+   and "-slice-scale". */
+extern unsigned thread_time_slice;
+extern bool thread_slice_scaled;
+
+/* Scaling doubles the time slice for every SLICE_SCALE_STEP
+   priority levels below PRI_DEFAULT, so "-slice" may be at most
+   SLICE_MAX ticks for the slice at PRI_MIN to fit in an unsigned
+   int.  (SLICE_MAX needs <limits.h>.) */
+#define SLICE_SCALE_STEP 8
+#define SLICE_MAX (UINT_MAX >> ((PRI_DEFAULT - PRI_MIN) / SLICE_SCALE_STEP))
+
+/* If false (default), scheduler events are not recorded.
+   If true, set by kernel command-line option "-schedtrace", the
+   most recent ones are kept for thread_trace_read() and printed
+   at shutdown. */
+extern bool thread_trace;
+
 void thread_init(void);
 void thread_start(void);
+struct thread* thread_create_idle(struct cpu*);
+void thread_init_ap(void);
+void thread_start_ap(void) NO_RETURN;
 
-void thread_tick(void);
+void thread_tick(bool user);
 void thread_print_stats(void);
 
+struct schedtrace_event;
+size_t thread_trace_read(struct schedtrace_event*, size_t max);
+void thread_trace_dump(void);
+
 typedef void thread_func(void* aux);
 tid_t thread_create(const char* name, int priority, thread_func*, void*);
 
@@ -178,6 +228,7 @@ void thread_set_priority(int);
 
 /* Project 2 */
 void check_thread_yield(void);
+void thread_set_effective_priority(struct thread*, int priority);
 bool priority_comp(const struct list_elem* elem1, const struct list_elem* elem2, void* aux);
 
 int thread_get_nice(void);
@@ -185,4 +236,6 @@ void thread_set_nice(int);
 int thread_get_recent_cpu(void);
 int thread_get_load_avg(void);
 
+void rusage_add(struct rusage*, const struct rusage*);
+
 #endif /* threads/thread.h */
@@ -0,0 +1,153 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Number of worker threads. */
+#define WORKER_CNT 2
+
+/* Pending work items, highest priority first.  Work may be
+   scheduled from interrupt handlers, so this is accessed only
+   with interrupts off. */
+static struct list pending;
+
+/* Upped once for each work item scheduled.  Cancelling an item
+   does not take its up back, so a worker may wake to find nothing
+   to do. */
+static struct semaphore pending_cnt;
+
+static thread_func worker;
+static void schedule_expired(void* work_);
+
+/* Initializes the work queue and starts its worker threads.
+   Must be called after thread_start() and before any work is
+   scheduled. */
+void workqueue_init(void) {
+  int i;
+
+  list_init(&pending);
+  sema_init(&pending_cnt, 0);
+  for (i = 0; i < WORKER_CNT; i++) {
+    char name[16];
+    snprintf(name, sizeof name, "worker %d", i);
+    thread_create(name, PRI_DEFAULT, worker, NULL);
+  }
+}
+
+/* Initializes W to run FUNC, which may use AUX as it likes. */
+void work_init(struct work* w, work_func* func, void* aux) {
+  ASSERT(w != NULL);
+  ASSERT(func != NULL);
+
+  w->func = func;
+  w->aux = aux;
+  w->priority = PRI_DEFAULT;
+  w->pending = false;
+  w->timeout.pending = false;
+}
+
+/* Schedules W to run at PRIORITY.  Returns true if successful,
+   false if W was already pending, in which case it keeps its
+   place in line.  May be called from an interrupt handler. */
+bool work_schedule(struct work* w, int priority) {
+  enum intr_level old_level;
+  struct list_elem* e;
+
+  ASSERT(w != NULL);
+  ASSERT(PRI_MIN <= priority && priority <= PRI_MAX);
+
+  old_level = intr_disable();
+  if (w->pending) {
+    intr_set_level(old_level);
+    return false;
+  }
+  w->pending = true;
+  w->priority = priority;
+
+  /* Go behind every item of equal or higher priority. */
+  for (e = list_rbegin(&pending); e != list_rend(&pending); e = list_prev(e))
+    if (list_entry(e, struct work, elem)->priority >= priority)
+      break;
+  list_insert(list_next(e), &w->elem);
+  intr_set_level(old_level);
+
+  sema_up(&pending_cnt);
+  return true;
+}
+
+/* Schedules W to run at PRIORITY once TICKS timer ticks have
+   passed.  Returns true if successful, false if W was already
+   pending or waiting out a delay, in which case it is left as it
+   was.  May be called from an interrupt handler. */
+bool work_schedule_after(struct work* w, int priority, int64_t ticks) {
+  enum intr_level old_level;
+  bool scheduled;
+
+  ASSERT(w != NULL);
+  ASSERT(PRI_MIN <= priority && priority <= PRI_MAX);
+
+  /* W's priority orders the pending list, so it must not change
+     while W is on it. */
+  old_level = intr_disable();
+  scheduled = !w->pending && !w->timeout.pending;
+  if (scheduled) {
+    w->priority = priority;
+    timeout_add(&w->timeout, timer_ticks() + ticks, schedule_expired, w);
+  }
+  intr_set_level(old_level);
+  return scheduled;
+}
+
+/* Timeout function for work_schedule_after(). */
+static void schedule_expired(void* work_) {
+  struct work* w = work_;
+  work_schedule(w, w->priority);
+}
+
+/* Cancels W if it is pending or waiting out a delay.  Returns
+   true if W was cancelled, false if it was neither, for example
+   because it has already started to run. */
+bool work_cancel(struct work* w) {
+  enum intr_level old_level;
+  bool cancelled;
+
+  ASSERT(w != NULL);
+
+  old_level = intr_disable();
+  cancelled = timeout_cancel(&w->timeout);
+  if (w->pending) {
+    list_remove(&w->elem);
+    w->pending = false;
+    cancelled = true;
+  }
+  intr_set_level(old_level);
+
+  return cancelled;
+}
+
+/* Worker thread: runs pending work items one at a time, each at
+   the priority it was scheduled with.  Under -mlfqs,
+   thread_set_priority() does nothing, so the worker runs at the
+   priority that the scheduler computes for it instead. */
+static void worker(void* aux UNUSED) {
+  for (;;) {
+    enum intr_level old_level;
+    struct work* w = NULL;
+
+    sema_down(&pending_cnt);
+
+    old_level = intr_disable();
+    if (!list_empty(&pending)) {
+      w = list_entry(list_pop_front(&pending), struct work, elem);
+      w->pending = false;
+    }
+    intr_set_level(old_level);
+
+    if (w != NULL) {
+      thread_set_priority(w->priority);
+      w->func(w);
+    }
+  }
+}
@@ -0,0 +1,47 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/timer.h"
+
+/* Deferred work.
+
+   A work item is a function to be run later, in a kernel thread,
+   by one of a small pool of worker threads.  Work may be
+   scheduled from anywhere, including interrupt handlers, so that
+   slow work can be moved off latency-critical paths without each
+   subsystem creating threads of its own.
+
+   Pending items run highest priority first, FIFO among equal
+   priorities, and each runs with its worker at the priority it
+   was scheduled with.  The multi-level feedback queue scheduler
+   (-mlfqs) sets every thread's priority itself, so there an
+   item's priority only orders the pending items, and its worker
+   runs at whatever priority the scheduler gives it.  A work
+   function may sleep, and it may reschedule its own work item.
+
+   The caller owns the struct work, which must stay valid until
+   the item has run or been cancelled.  Like struct timeout, it is
+   not allocated by the work queue. */
+
+struct work;
+typedef void work_func(struct work*);
+
+struct work {
+  struct list_elem elem;  /* Element in the pending list. */
+  work_func* func;        /* Function to run. */
+  void* aux;              /* Auxiliary data for FUNC. */
+  int priority;           /* Priority to run at. */
+  bool pending;           /* Scheduled but not yet started? */
+  struct timeout timeout; /* For work_schedule_after(). */
+};
+
+void workqueue_init(void);
+void work_init(struct work*, work_func*, void* aux);
+bool work_schedule(struct work*, int priority);
+bool work_schedule_after(struct work*, int priority, int64_t ticks);
+bool work_cancel(struct work*);
+
+#endif /* threads/workqueue.h */
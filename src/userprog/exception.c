@@ -5,6 +5,10 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -136,9 +140,18 @@ static void page_fault(struct intr_frame* f) {
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-  /* To implement virtual memory, delete the rest of the function
-     body, and replace it with code that brings in the page to
-     which fault_addr refers. */
+#ifdef VM
+  /* A page of the process's address space that has not been
+     loaded yet, or the stack growing.  Bring in the page and
+     retry the access.  The kernel faults here too when a system
+     call touches such a page, in which case the user stack
+     pointer was saved on entry to the system call. */
+  if (user)
+    thread_current()->user_esp = f->esp;
+  if (not_present && is_user_vaddr(fault_addr) && page_in(fault_addr, write))
+    return;
+#endif
+
   printf("Page fault at %p: %s error %s page in %s context.\n", fault_addr,
          not_present ? "not present" : "rights violation", write ? "writing" : "reading",
          user ? "user" : "kernel");
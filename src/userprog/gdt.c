@@ -30,25 +30,28 @@ static uint64_t make_data_desc(int dpl);
 static uint64_t make_tss_desc(void* laddr);
 static uint64_t make_gdtr_operand(uint16_t limit, void* base);
 
-/* Sets up a proper GDT.  The bootstrap loader's GDT didn't
-   include user-mode selectors or a TSS, but we need both now. */
+/* Sets up a proper GDT for the running CPU, which must already
+   have its TSS.  The bootstrap loader's GDT didn't include
+   user-mode selectors or a TSS, but we need both now.  All CPUs
+   share the GDT, each with its own TSS descriptor. */
 void gdt_init(void) {
+  int cpu = cpu_current()->id;
   uint64_t gdtr_operand;
 
-  /* Initialize GDT. */
+  /* Initialize GDT.  Every CPU writes the same shared entries. */
   gdt[SEL_NULL / sizeof *gdt] = 0;
   gdt[SEL_KCSEG / sizeof *gdt] = make_code_desc(0);
   gdt[SEL_KDSEG / sizeof *gdt] = make_data_desc(0);
   gdt[SEL_UCSEG / sizeof *gdt] = make_code_desc(3);
   gdt[SEL_UDSEG / sizeof *gdt] = make_data_desc(3);
-  gdt[SEL_TSS / sizeof *gdt] = make_tss_desc(tss_get());
+  gdt[SEL_TSS_CPU(cpu) / sizeof *gdt] = make_tss_desc(tss_get());
 
   /* Load GDTR, TR.  See [IA32-v3a] 2.4.1 "Global Descriptor
      Table Register (GDTR)", 2.4.4 "Task Register (TR)", and
      6.2.4 "Task Register".  */
   gdtr_operand = make_gdtr_operand(sizeof gdt - 1, gdt);
   asm volatile("lgdt %0" : : "m"(gdtr_operand));
-  asm volatile("ltr %w0" : : "q"(SEL_TSS));
+  asm volatile("ltr %w0" : : "q"(SEL_TSS_CPU(cpu)));
 }
 
 /* System segment or code/data segment? */
@@ -19,10 +19,21 @@
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 static thread_func start_process NO_RETURN;
 static bool load(const char* cmdline, void (**eip)(void), void** esp);
 
+/* Wait information shared by parents and children. */
+struct slab_cache wait_info_cache =
+    SLAB_CACHE_INITIALIZER(wait_info_cache, "wait_info", sizeof(struct wait_info), NULL);
+
+/* Rows of processes' file descriptor tables. */
+struct slab_cache fd_row_cache =
+    SLAB_CACHE_INITIALIZER(fd_row_cache, "fd_row", sizeof(struct fd_row), NULL);
+
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
    before process_execute() returns.  Returns the new process's
@@ -45,7 +56,7 @@ tid_t process_execute(const char* file_name) {
   strlcpy(wi_fn, fn_copy, PGSIZE);
 
   /* Initialize wait_info */
-  struct wait_info* info = malloc(sizeof(struct wait_info));
+  struct wait_info* info = slab_alloc(&wait_info_cache);
   info->file_name = wi_fn;
   sema_init(&info->sema, 0);
   info->loaded = 0;
@@ -59,10 +70,10 @@ tid_t process_execute(const char* file_name) {
   /* Lock until the child is successfully loaded. If not, free the wait info. */
   sema_down(&info->sema);
   if (info->loaded == false) {
-    free(info);
+    slab_free(&wait_info_cache, info);
     return -1;
   }
-  free(info);
+  slab_free(&wait_info_cache, info);
   if (tid == TID_ERROR) {
     palloc_free_page(wi_fn);
   }
@@ -142,6 +153,7 @@ int process_wait(tid_t child_tid UNUSED) {
   /* Wait for child. */
   wi->waited = true;
   sema_down(&wi->sema);
+  rusage_add(&cur_thread->child_usage, &wi->usage);
 
   int ec = wi->exit_code;
   return ec;
@@ -153,6 +165,10 @@ void process_exit(void) {
   struct wait_info* wi = cur->wait_info;
   uint32_t* pd;
 
+#ifdef VM
+  page_table_destroy();
+#endif
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -170,9 +186,11 @@ void process_exit(void) {
   }
 
   lock_acquire(&wi->lock);
+  wi->usage = cur->usage;
+  rusage_add(&wi->usage, &cur->child_usage);
   wi->ref_cnt--;
   if (wi->ref_cnt == 0) {
-    free(wi);
+    slab_free(&wait_info_cache, wi);
   } else {
     sema_up(&wi->sema);
     lock_release(&wi->lock);
@@ -186,7 +204,7 @@ void process_exit(void) {
     lock_acquire(&cwi->lock);
     cwi->ref_cnt--;
     if (cwi->ref_cnt == 0) {
-      free(cwi);
+      slab_free(&wait_info_cache, cwi);
     } else {
       lock_release(&cwi->lock);
     }
@@ -198,7 +216,7 @@ void process_exit(void) {
     current = list_pop_front(fdt_ptr);
     struct fd_row* row = list_entry(current, struct fd_row, elem);
     file_close(row->open_file_object);
-    free(row);
+    slab_free(&fd_row_cache, row);
   }
 
   if (cur->cur_file != NULL) {
@@ -214,7 +232,7 @@ void process_exit(void) {
     lock_acquire(&(cur->wait_info->lock));
     cwi->ref_cnt--;
     if (cwi->ref_cnt == 0) {
-      free(cwi);
+      slab_free(&wait_info_cache, cwi);
     }
     lock_release(&(cur->wait_info->lock));
   }
@@ -320,6 +338,10 @@ bool load(const char* file_name, void (**eip)(void), void** esp) {
   t->pagedir = pagedir_create();
   if (t->pagedir == NULL)
     goto done;
+#ifdef VM
+  if (!page_table_create())
+    goto done;
+#endif
   process_activate();
 
   /* Parse argv[0] */
@@ -456,7 +478,9 @@ done:
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page(void* upage, void* kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -529,6 +553,14 @@ static bool load_segment(struct file* file, off_t ofs, uint8_t* upage, uint32_t
     size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
     size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+    /* Only record where the page comes from.  It is read or
+       zeroed when the process first touches it. */
+    if (page_read_bytes > 0 ? !page_add_file(upage, file, ofs, page_read_bytes, writable)
+                            : !page_add_zero(upage, writable))
+      return false;
+    ofs += PGSIZE;
+#else
     /* Get a page of memory. */
     uint8_t* kpage = palloc_get_page(PAL_USER);
     if (kpage == NULL)
@@ -546,6 +578,7 @@ static bool load_segment(struct file* file, off_t ofs, uint8_t* upage, uint32_t
       palloc_free_page(kpage);
       return false;
     }
+#endif
 
     /* Advance. */
     read_bytes -= page_read_bytes;
@@ -558,20 +591,27 @@ static bool load_segment(struct file* file, off_t ofs, uint8_t* upage, uint32_t
 /* Create a minimal stack by mapping a zeroed page at the top of
    user virtual memory. */
 static bool setup_stack(void** esp) {
-  uint8_t* kpage;
+  uint8_t* upage = ((uint8_t*)PHYS_BASE) - PGSIZE;
   bool success = false;
 
-  kpage = palloc_get_page(PAL_USER | PAL_ZERO);
+#ifdef VM
+  /* Make the stack page an ordinary zero page, so that it can be
+     evicted like any other. */
+  success = page_add_zero(upage, true) && page_in(upage, true);
+#else
+  uint8_t* kpage = palloc_get_page(PAL_USER | PAL_ZERO);
   if (kpage != NULL) {
-    success = install_page(((uint8_t*)PHYS_BASE) - PGSIZE, kpage, true);
-    if (success)
-      *esp = PHYS_BASE;
-    else
+    success = install_page(upage, kpage, true);
+    if (!success)
       palloc_free_page(kpage);
   }
+#endif
+  if (success)
+    *esp = PHYS_BASE;
   return success;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -589,3 +629,4 @@ static bool install_page(void* upage, void* kpage, bool writable) {
   return (pagedir_get_page(t->pagedir, upage) == NULL &&
           pagedir_set_page(t->pagedir, upage, kpage, writable));
 }
+#endif
@@ -1,6 +1,7 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include "threads/slab.h"
 #include "threads/thread.h"
 
 typedef struct args_addr {
@@ -10,6 +11,9 @@ typedef struct args_addr {
 
 typedef struct list args_addr_list_t;
 
+extern struct slab_cache wait_info_cache;
+extern struct slab_cache fd_row_cache;
+
 tid_t process_execute(const char* file_name);
 int process_wait(tid_t);
 void process_exit(void);
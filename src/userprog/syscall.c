@@ -1,51 +1,117 @@
 #include <stdio.h>
 #include <string.h>
+#include <schedtrace.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "devices/block.h"
 #include "devices/input.h"
 #include "devices/shutdown.h"
 #include "userprog/process.h"
 #include "userprog/pagedir.h"
 #include "userprog/syscall.h"
 #include "userprog/pagedir.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 static void syscall_handler(struct intr_frame*);
-<<<<<<< HEAD
-
-=======
->>>>>>> 9a3485af536ad5468069ee127682332d7be91969
+static bool is_mapped(const void* uaddr, bool write);
+static bool copy_in_string(char* dst, const char* usrc, size_t size);
 
 /*  check whether the pointer is valid. */
 void check_ptr(void* ptr, size_t size) {
-  struct thread* curr_thread = thread_current();
   if (!ptr) {
     terminate(-1);
   } else if (!is_user_vaddr(ptr)) {
     terminate(-1);
   } else if (!is_user_vaddr(ptr + size)) {
     terminate(-1);
-  } else if (!pagedir_get_page(curr_thread->pagedir, ptr)) {
+  } else if (!is_mapped(ptr, false)) {
     terminate(-1);
-  } else if (!pagedir_get_page(curr_thread->pagedir, ptr + size)) {
+  } else if (!is_mapped(ptr + size, false)) {
     terminate(-1);
   }
 }
 
-<<<<<<< HEAD
-void syscall_init(void) {
+/* Checks that every page of the SIZE bytes at user address
+   BUFFER is mapped, so that the kernel can copy to or from it
+   without faulting.  WRITE is true if the kernel will write to
+   BUFFER.  In the VM kernel, the pages are also pinned in memory
+   until release_buffer() is called. */
+static void check_buffer(const void* buffer, size_t size, bool write) {
+  const uint8_t* p;
+
+  if (size == 0)
+    return;
+  if (buffer == NULL || !is_user_vaddr(buffer) || !is_user_vaddr(buffer + size - 1))
+    terminate(-1);
+  for (p = pg_round_down(buffer); p <= (const uint8_t*)buffer + size - 1; p += PGSIZE) {
+#ifdef VM
+    if (!page_pin(p, write))
+      terminate(-1);
+#else
+    if (!is_mapped(p, write))
+      terminate(-1);
+#endif
+  }
+}
 
-  intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
+/* Unpins the pages pinned by check_buffer(BUFFER, SIZE). */
+static void release_buffer(const void* buffer UNUSED, size_t size UNUSED) {
+#ifdef VM
+  const uint8_t* p;
+
+  if (size == 0)
+    return;
+  for (p = pg_round_down(buffer); p <= (const uint8_t*)buffer + size - 1; p += PGSIZE)
+    page_unpin(p);
+#endif
 }
-=======
+
+/* Copies the null-terminated string at user address USRC into
+   DST, which has room for SIZE bytes, checking each page of the
+   string before reading from it.  Terminates the process if the
+   string runs into memory it cannot read.  Returns false if the
+   string does not fit in SIZE bytes. */
+static bool copy_in_string(char* dst, const char* usrc, size_t size) {
+  size_t i;
+
+  for (i = 0; i < size; i++) {
+    const char* p = usrc + i;
+    if ((i == 0 || pg_ofs(p) == 0) && (p == NULL || !is_user_vaddr(p) || !is_mapped(p, false)))
+      terminate(-1);
+    dst[i] = *p;
+    if (dst[i] == '\0')
+      return true;
+  }
+  return false;
+}
+
+/* Returns true if user address UADDR is mapped in the running
+   process's page directory, and writable if WRITE is true,
+   loading its page first if it is in the process's address space
+   but not yet in memory. */
+static bool is_mapped(const void* uaddr, bool write) {
+  uint32_t* pd = thread_current()->pagedir;
+
+  if (pagedir_get_page(pd, uaddr) != NULL)
+    return !write || pagedir_is_writable(pd, uaddr);
+#ifdef VM
+  return page_in(uaddr, write);
+#else
+  return false;
+#endif
+}
+
 void syscall_init(void) { intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall"); }
->>>>>>> 9a3485af536ad5468069ee127682332d7be91969
 
 static void syscall_handler(struct intr_frame* f UNUSED) {
   uint32_t* args = ((uint32_t*)f->esp);
@@ -57,6 +123,12 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
    * include it in your final submission.
    */
 
+#ifdef VM
+  /* Save the stack pointer, so that a stack access by the kernel
+     on the process's behalf can grow its stack. */
+  thread_current()->user_esp = f->esp;
+#endif
+
   check_ptr(args, sizeof(uint32_t));
   check_ptr(&args[1], sizeof(uint32_t));
 
@@ -144,7 +216,7 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
 
       if (strcmp(file_name, "/") == 0) {
         struct dir* new_dir = dir_open_root();
-        struct fd_row* new_fd = malloc(sizeof(struct fd_row));
+        struct fd_row* new_fd = slab_alloc(&fd_row_cache);
         new_fd->fd = current_thread->next_aval_fd++;
         new_fd->open_file_object = NULL;
         new_fd->is_dir = true;
@@ -154,7 +226,7 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
         f->eax = new_fd->fd;
       } else if (dir != NULL && dir_lookup(dir, last_part, &inode) && inode_is_dir(inode)) {
         struct dir* new_dir = dir_open(inode);
-        struct fd_row* new_fd = malloc(sizeof(struct fd_row));
+        struct fd_row* new_fd = slab_alloc(&fd_row_cache);
         new_fd->fd = current_thread->next_aval_fd++;
         new_fd->open_file_object = NULL;
         new_fd->is_dir = true;
@@ -167,7 +239,7 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
         if (!curr_file) {
           f->eax = -1;
         } else {
-          struct fd_row* new_fd = malloc(sizeof(struct fd_row));
+          struct fd_row* new_fd = slab_alloc(&fd_row_cache);
           new_fd->fd = current_thread->next_aval_fd++;
           new_fd->open_file_object = curr_file;
           new_fd->is_dir = false;
@@ -195,15 +267,12 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
           }
         }
       }
-<<<<<<< HEAD
-
-=======
->>>>>>> 9a3485af536ad5468069ee127682332d7be91969
     } break;
 
     case SYS_READ: {
       int fd = args[1];
       check_ptr((void*)args[2], sizeof(char*));
+      check_buffer((void*)args[2], args[3], true);
       if (args[3] == 0) {
         f->eax = 0;
       } else if (fd == 0) {
@@ -235,10 +304,12 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
           }
         }
       }
+      release_buffer((void*)args[2], args[3]);
     } break;
 
     case SYS_WRITE: {
       check_ptr((void*)args[2], sizeof(char*));
+      check_buffer((void*)args[2], args[3], false);
       int fd = args[1];
       if (fd < 0 || fd == 0) {
         terminate(-1);
@@ -277,6 +348,7 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
           }
         }
       }
+      release_buffer((void*)args[2], args[3]);
     } break;
 
     case SYS_SEEK: {
@@ -427,6 +499,78 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
       f->eax = filesys_create(dir, 0, true);
     } break;
 
+    case SYS_IOSTAT: {
+      check_ptr(&args[2], sizeof(uint32_t));
+      struct iostat* user_stats = (struct iostat*)args[2];
+      struct block* block;
+      char name[sizeof block->name];
+      struct iostat stats;
+      bool found = copy_in_string(name, (const char*)args[1], sizeof name);
+      check_buffer(user_stats, sizeof *user_stats, true);
+      block = found ? block_get_by_name(name) : NULL;
+      f->eax = block != NULL;
+      if (block != NULL) {
+        block_get_stats(block, &stats);
+        memcpy(user_stats, &stats, sizeof stats);
+      }
+      release_buffer(user_stats, sizeof *user_stats);
+    } break;
+
+    case SYS_SCHEDTRACE: {
+      check_ptr(&args[2], sizeof(uint32_t));
+      struct schedtrace_event* events = (struct schedtrace_event*)args[1];
+      int max = (int)args[2] < SCHEDTRACE_SIZE ? (int)args[2] : SCHEDTRACE_SIZE;
+      f->eax = 0;
+      if (max > 0) {
+        /* Take the snapshot in kernel memory, since a fault on the
+           user buffer would sleep with interrupts off. */
+        struct schedtrace_event* snapshot;
+        check_buffer(events, max * sizeof *events, true);
+        snapshot = malloc(max * sizeof *snapshot);
+        if (snapshot != NULL) {
+          f->eax = thread_trace_read(snapshot, max);
+          memcpy(events, snapshot, f->eax * sizeof *snapshot);
+          free(snapshot);
+        }
+        release_buffer(events, max * sizeof *events);
+      }
+    } break;
+
+    case SYS_GETRUSAGE: {
+      check_ptr(&args[2], sizeof(uint32_t));
+      struct thread* cur = thread_current();
+      struct rusage* usage = (struct rusage*)args[2];
+      struct rusage copy;
+      check_buffer(usage, sizeof *usage, true);
+      f->eax = true;
+      if ((int)args[1] == RUSAGE_SELF)
+        copy = cur->usage;
+      else if ((int)args[1] == RUSAGE_CHILDREN)
+        copy = cur->child_usage;
+      else
+        f->eax = false;
+      if (f->eax)
+        memcpy(usage, &copy, sizeof copy);
+      release_buffer(usage, sizeof *usage);
+    } break;
+
+    case SYS_MEMSTAT: {
+      check_ptr(&args[1], sizeof(uint32_t));
+      struct memstat* user_stats = (struct memstat*)args[1];
+      check_buffer(user_stats, sizeof *user_stats, true);
+      /* Gather into kernel memory, since the statistics are
+         collected partly under spin locks. */
+      struct memstat* stats = malloc(sizeof *stats);
+      f->eax = stats != NULL;
+      if (stats != NULL) {
+        palloc_get_stats(stats);
+        malloc_get_stats(stats);
+        memcpy(user_stats, stats, sizeof *stats);
+        free(stats);
+      }
+      release_buffer(user_stats, sizeof *user_stats);
+    } break;
+
     case SYS_CHDIR: {
       check_ptr((void*)args[1], sizeof(const char*));
       const char* pathway = (char*)args[1];
@@ -2,6 +2,7 @@
 #include <debug.h>
 #include <stddef.h>
 #include "userprog/gdt.h"
+#include "threads/cpu.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -71,29 +72,31 @@ struct tss {
   uint16_t trace, bitmap;
 };
 
-/* Kernel TSS. */
-static struct tss* tss;
+/* Kernel TSSes, one per CPU, indexed by CPU number. */
+static struct tss* tss[CPU_MAX];
 
-/* Initializes the kernel TSS. */
+/* Initializes the running CPU's kernel TSS. */
 void tss_init(void) {
+  struct tss* t;
+
   /* Our TSS is never used in a call gate or task gate, so only a
      few fields of it are ever referenced, and those are the only
      ones we initialize. */
-  tss = palloc_get_page(PAL_ASSERT | PAL_ZERO);
-  tss->ss0 = SEL_KDSEG;
-  tss->bitmap = 0xdfff;
+  t = tss[cpu_current()->id] = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+  t->ss0 = SEL_KDSEG;
+  t->bitmap = 0xdfff;
   tss_update();
 }
 
-/* Returns the kernel TSS. */
+/* Returns the running CPU's kernel TSS.  Interrupts must be
+   off. */
 struct tss* tss_get(void) {
-  ASSERT(tss != NULL);
-  return tss;
-}
+  struct tss* t = tss[cpu_current()->id];
 
-/* Sets the ring 0 stack pointer in the TSS to point to the end
-   of the thread stack. */
-void tss_update(void) {
-  ASSERT(tss != NULL);
-  tss->esp0 = (uint8_t*)thread_current() + PGSIZE;
+  ASSERT(t != NULL);
+  return t;
 }
+
+/* Sets the ring 0 stack pointer in the running CPU's TSS to
+   point to the end of the thread stack. */
+void tss_update(void) { tss_get()->esp0 = (uint8_t*)thread_current() + PGSIZE; }
@@ -0,0 +1,142 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+
+/* Frame table entries. */
+static struct slab_cache frame_cache =
+    SLAB_CACHE_INITIALIZER(frame_cache, "frame", sizeof(struct frame), NULL);
+
+static struct list frames;     /* All frames, in clock order. */
+static struct list_elem* hand; /* Next frame for the clock to look at. */
+static size_t frame_cnt;       /* Number of frames. */
+static struct lock frame_lock; /* Protects the members above and below. */
+
+/* Statistics. */
+static size_t max_frames;  /* Most frames at once. */
+static uint64_t evictions; /* Pages evicted. */
+
+static struct frame* frame_evict(void);
+
+/* Initializes the frame table. */
+void frame_init(void) {
+  list_init(&frames);
+  hand = list_end(&frames);
+  lock_init(&frame_lock);
+}
+
+/* Allocates a frame for page P, evicting another page if the
+   user pool is empty, and returns it pinned.  FLAGS may include
+   PAL_ZERO.  Returns a null pointer if every frame is pinned or
+   no page could be evicted. */
+struct frame* frame_alloc(struct page* p, enum palloc_flags flags) {
+  void* kpage = palloc_get_page(PAL_USER | flags);
+  struct frame* f;
+
+  if (kpage == NULL) {
+    f = frame_evict();
+    if (f == NULL)
+      return NULL;
+    if (flags & PAL_ZERO)
+      memset(f->kpage, 0, PGSIZE);
+    f->page = p;
+    return f;
+  }
+
+  f = slab_alloc(&frame_cache);
+  if (f == NULL) {
+    palloc_free_page(kpage);
+    return NULL;
+  }
+  f->kpage = kpage;
+  f->page = p;
+  f->pinned = true;
+
+  /* Insert just behind the hand, so that the new frame is the
+     last one the clock looks at. */
+  lock_acquire(&frame_lock);
+  list_insert(hand, &f->elem);
+  if (++frame_cnt > max_frames)
+    max_frames = frame_cnt;
+  lock_release(&frame_lock);
+  return f;
+}
+
+/* Removes frame F from the frame table and frees it.  F's page
+   must be locked by the caller, and no longer mapped. */
+void frame_free(struct frame* f) {
+  lock_acquire(&frame_lock);
+  if (hand == &f->elem)
+    hand = list_next(hand);
+  list_remove(&f->elem);
+  frame_cnt--;
+  lock_release(&frame_lock);
+
+  palloc_free_page(f->kpage);
+  slab_free(&frame_cache, f);
+}
+
+/* Prints frame table statistics. */
+void frame_print_stats(void) {
+  printf("Frames: %zu in use, %zu at most, %llu evicted\n", frame_cnt, max_frames, evictions);
+}
+
+/* Chooses a frame by the clock algorithm, writes its page out,
+   and returns it, still in the frame table but pinned.  Returns
+   a null pointer if no page could be evicted. */
+static struct frame* frame_evict(void) {
+  size_t i;
+
+  lock_acquire(&frame_lock);
+
+  /* Two sweeps clear every accessed bit, so a frame that is
+     neither pinned nor locked is found in that many steps. */
+  for (i = 0; i < 2 * frame_cnt; i++) {
+    struct frame* f;
+    struct page* p;
+    uint32_t* pd;
+
+    if (hand == list_end(&frames))
+      hand = list_begin(&frames);
+    f = list_entry(hand, struct frame, elem);
+    hand = list_next(hand);
+
+    if (f->pinned)
+      continue;
+    p = f->page;
+    pd = p->owner->pagedir;
+    if (pagedir_is_accessed(pd, p->upage)) {
+      pagedir_set_accessed(pd, p->upage, false);
+      continue;
+    }
+
+    /* The page's owner may be loading or freeing it.  Don't wait
+       for it, since it may be waiting for the frame table. */
+    if (!lock_try_acquire(&p->lock))
+      continue;
+    f->pinned = true;
+    lock_release(&frame_lock);
+
+    if (page_out(p)) {
+      lock_release(&p->lock);
+      lock_acquire(&frame_lock);
+      evictions++;
+      lock_release(&frame_lock);
+      return f;
+    }
+
+    /* Nowhere to put the page, or its owner is running on another
+       CPU, so try another. */
+    f->pinned = false;
+    lock_release(&p->lock);
+    lock_acquire(&frame_lock);
+  }
+  lock_release(&frame_lock);
+  return NULL;
+}
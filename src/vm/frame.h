@@ -0,0 +1,37 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <list.h>
+#include <stdbool.h>
+#include "threads/palloc.h"
+
+/* Frame table.
+
+   Every page of user memory that holds a process's page is a
+   frame, listed in the global frame table.  When the user pool
+   is exhausted, a frame is taken from some process by the clock
+   algorithm: a hand sweeps the table in order, clearing each
+   page's accessed bit and taking the first page found with the
+   bit already clear, that is, one not used since the hand last
+   passed.
+
+   A frame is pinned while its page is being loaded or written
+   out, and while the kernel is copying to or from it, and the
+   hand passes over it then. */
+
+struct page;
+
+/* A frame of user memory. */
+struct frame {
+  void* kpage;           /* Kernel virtual address. */
+  struct page* page;     /* Page held. */
+  bool pinned;           /* Exempt from eviction? */
+  struct list_elem elem; /* Element in the frame table. */
+};
+
+void frame_init(void);
+struct frame* frame_alloc(struct page*, enum palloc_flags);
+void frame_free(struct frame*);
+void frame_print_stats(void);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,332 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* Supplemental page table entries. */
+static struct slab_cache page_cache =
+    SLAB_CACHE_INITIALIZER(page_cache, "page", sizeof(struct page), NULL);
+
+/* Maximum size of a user stack, in pages.  Set by kernel
+   command-line option "-stack". */
+size_t page_stack_max = 2048;
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_destroy;
+static struct page* page_create(void* upage, enum page_type, bool writable);
+static bool page_add(struct page*);
+static bool page_load(struct page*);
+static struct page* page_get(const void* uaddr);
+static struct page* page_lookup(struct thread*, const void* uaddr);
+static bool is_stack_access(const void* uaddr);
+
+/* Creates an empty supplemental page table for the running
+   process.  Returns true if successful, false if memory is not
+   available. */
+bool page_table_create(void) {
+  struct thread* t = thread_current();
+  struct hash* pages;
+
+  ASSERT(t->pages == NULL);
+
+  pages = malloc(sizeof *pages);
+  if (pages == NULL)
+    return false;
+  if (!hash_init(pages, page_hash, page_less, NULL)) {
+    free(pages);
+    return false;
+  }
+  t->pages = pages;
+  return true;
+}
+
+/* Destroys the running process's supplemental page table, if it
+   has one, freeing its pages' frames and swap slots.  Must be
+   called before the process's page directory is destroyed. */
+void page_table_destroy(void) {
+  struct thread* t = thread_current();
+
+  if (t->pages != NULL) {
+    hash_destroy(t->pages, page_destroy);
+    free(t->pages);
+    t->pages = NULL;
+  }
+}
+
+/* Adds UPAGE to the running process's address space, to be
+   loaded from READ_BYTES bytes of FILE starting at offset OFS,
+   followed by zeros to the end of the page.  FILE must stay open
+   and unchanged as long as the process runs.  Returns true if
+   successful, false if UPAGE is already in the address space or
+   memory is not available. */
+bool page_add_file(void* upage, struct file* file, off_t ofs, size_t read_bytes, bool writable) {
+  struct page* p;
+
+  ASSERT(read_bytes > 0 && read_bytes <= PGSIZE);
+
+  p = page_create(upage, PAGE_FILE, writable);
+  if (p == NULL)
+    return false;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  return page_add(p);
+}
+
+/* Adds UPAGE to the running process's address space, to be
+   filled with zeros when it is first used.  Returns true if
+   successful, false if UPAGE is already in the address space or
+   memory is not available. */
+bool page_add_zero(void* upage, bool writable) {
+  struct page* p = page_create(upage, PAGE_ZERO, writable);
+  return p != NULL && page_add(p);
+}
+
+/* Makes sure that the page containing user address UADDR is in
+   memory and mapped in the running process's page directory,
+   loading it if it is not.  If UADDR is not in the process's
+   address space but is a stack access, grows the stack to include
+   it first.  Returns true if successful, false if UADDR is not in
+   the process's address space, WRITE is true and the page is
+   read-only, or the page cannot be loaded. */
+bool page_in(const void* uaddr, bool write) {
+  struct page* p = page_get(uaddr);
+  bool success;
+
+  if (p == NULL || (write && !p->writable))
+    return false;
+
+  lock_acquire(&p->lock);
+  success = p->frame != NULL || page_load(p);
+  lock_release(&p->lock);
+  return success;
+}
+
+/* Like page_in(), but also pins the page in memory until
+   page_unpin() is called for it, so that the kernel can access
+   it without faulting, for example while holding locks that the
+   page fault handler would need. */
+bool page_pin(const void* uaddr, bool write) {
+  struct page* p = page_get(uaddr);
+  bool success;
+
+  if (p == NULL || (write && !p->writable))
+    return false;
+
+  lock_acquire(&p->lock);
+  success = p->frame != NULL || page_load(p);
+  if (success)
+    p->frame->pinned = true;
+  lock_release(&p->lock);
+  return success;
+}
+
+/* Allows the page containing UADDR, pinned by page_pin(), to be
+   evicted again. */
+void page_unpin(const void* uaddr) {
+  struct page* p = page_lookup(thread_current(), uaddr);
+
+  ASSERT(p != NULL);
+
+  lock_acquire(&p->lock);
+  if (p->frame != NULL)
+    p->frame->pinned = false;
+  lock_release(&p->lock);
+}
+
+/* Evicts page P from its frame, which must be pinned, writing it
+   to swap if it cannot be loaded again from its source.  P's
+   lock must be held.  Returns true if successful, false if swap
+   is full or P's owner is running on another CPU, in which case P
+   stays loaded. */
+bool page_out(struct page* p) {
+  uint32_t* pd = p->owner->pagedir;
+  enum intr_level old_level;
+  bool dirty;
+
+  ASSERT(lock_held_by_current_thread(&p->lock));
+  ASSERT(p->frame != NULL && p->frame->pinned);
+
+  /* Unmap the page first, so that the process cannot modify it
+     from here on, then see whether it was modified.  Another CPU
+     running the owner could go on using the mapping from its TLB,
+     so leave such a page alone.  With interrupts off, no CPU can
+     switch to the owner until the mapping is gone. */
+  old_level = intr_disable();
+  if (p->owner != thread_current() && p->owner->status == THREAD_RUNNING) {
+    intr_set_level(old_level);
+    return false;
+  }
+  pagedir_clear_page(pd, p->upage);
+  intr_set_level(old_level);
+  dirty = pagedir_is_dirty(pd, p->upage);
+
+  if (p->type == PAGE_SWAP || dirty) {
+    size_t slot = swap_out(p->frame->kpage);
+    if (slot == SWAP_ERROR) {
+      pagedir_set_page(pd, p->upage, p->frame->kpage, p->writable);
+      pagedir_set_dirty(pd, p->upage, dirty);
+      return false;
+    }
+    p->type = PAGE_SWAP;
+    p->swap_slot = slot;
+  }
+  p->frame = NULL;
+  return true;
+}
+
+/* Allocates and returns a new page at UPAGE of the given TYPE,
+   owned by the running process, or a null pointer if memory is
+   not available. */
+static struct page* page_create(void* upage, enum page_type type, bool writable) {
+  struct page* p = slab_alloc(&page_cache);
+
+  if (p != NULL) {
+    p->upage = upage;
+    p->owner = thread_current();
+    p->type = type;
+    p->writable = writable;
+    p->file = NULL;
+    p->ofs = 0;
+    p->read_bytes = 0;
+    p->swap_slot = SWAP_ERROR;
+    lock_init(&p->lock);
+    p->frame = NULL;
+  }
+  return p;
+}
+
+/* Adds P to the running process's page table.  Returns true if
+   successful, otherwise frees P and returns false. */
+static bool page_add(struct page* p) {
+  struct thread* t = thread_current();
+
+  ASSERT(t->pages != NULL);
+  ASSERT(pg_ofs(p->upage) == 0);
+
+  if (hash_insert(t->pages, &p->elem) != NULL) {
+    slab_free(&page_cache, p);
+    return false;
+  }
+  return true;
+}
+
+/* Loads page P, which must be locked by the caller and not
+   loaded, into a new frame and maps it.  Returns true if
+   successful, false if no frame can be had or the page cannot be
+   read. */
+static bool page_load(struct page* p) {
+  struct frame* f;
+
+  /* Zero pages come pre-cleared from the page allocator, when it
+     has any. */
+  f = frame_alloc(p, p->type == PAGE_ZERO ? PAL_ZERO : 0);
+  if (f == NULL)
+    return false;
+
+  if (p->type == PAGE_FILE) {
+    if (file_read_at(p->file, f->kpage, p->read_bytes, p->ofs) != (off_t)p->read_bytes) {
+      frame_free(f);
+      return false;
+    }
+    memset((uint8_t*)f->kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+  } else if (p->type == PAGE_SWAP) {
+    swap_in(p->swap_slot, f->kpage);
+    p->swap_slot = SWAP_ERROR;
+  }
+
+  if (!pagedir_set_page(p->owner->pagedir, p->upage, f->kpage, p->writable)) {
+    frame_free(f);
+    return false;
+  }
+
+  /* Count the page as used, so that the clock does not take it
+     before the faulting access is retried. */
+  pagedir_set_accessed(p->owner->pagedir, p->upage, true);
+  p->frame = f;
+  f->pinned = false;
+  return true;
+}
+
+/* Returns the page in the running process's address space that
+   contains UADDR, first adding it as a new stack page if UADDR
+   is a stack access.  Returns a null pointer if UADDR is not in
+   the address space or memory is not available. */
+static struct page* page_get(const void* uaddr) {
+  struct thread* t = thread_current();
+  struct page* p = page_lookup(t, uaddr);
+
+  if (p == NULL && t->pages != NULL && is_user_vaddr(uaddr) && is_stack_access(uaddr)) {
+    p = page_create(pg_round_down(uaddr), PAGE_ZERO, true);
+    if (p != NULL && !page_add(p))
+      p = NULL;
+  }
+  return p;
+}
+
+/* Returns true if an access to user address UADDR by the running
+   process should grow its stack: UADDR must be within
+   page_stack_max pages of the top of user memory and no more than
+   32 bytes below the process's stack pointer, since the 80x86
+   PUSHA instruction checks that much before it moves the stack
+   pointer.  Anything above the stack pointer is allowed, for
+   functions that reserve a large frame before touching it. */
+static bool is_stack_access(const void* uaddr) {
+  uintptr_t addr = (uintptr_t)uaddr;
+  uintptr_t esp = (uintptr_t)thread_current()->user_esp;
+
+  return addr + 32 >= esp && ((uintptr_t)PHYS_BASE - addr - 1) / PGSIZE < page_stack_max;
+}
+
+/* Returns the page in T's address space that contains UADDR, or
+   a null pointer if there is none. */
+static struct page* page_lookup(struct thread* t, const void* uaddr) {
+  struct page key;
+  struct hash_elem* e;
+
+  if (t->pages == NULL || !is_user_vaddr(uaddr))
+    return NULL;
+  key.upage = pg_round_down(uaddr);
+  e = hash_find(t->pages, &key.elem);
+  return e != NULL ? hash_entry(e, struct page, elem) : NULL;
+}
+
+/* Returns a hash value for the page that E refers to. */
+static unsigned page_hash(const struct hash_elem* e, void* aux UNUSED) {
+  const struct page* p = hash_entry(e, struct page, elem);
+  return hash_int(pg_no(p->upage));
+}
+
+/* Returns true if page A precedes page B. */
+static bool page_less(const struct hash_elem* a_, const struct hash_elem* b_, void* aux UNUSED) {
+  const struct page* a = hash_entry(a_, struct page, elem);
+  const struct page* b = hash_entry(b_, struct page, elem);
+  return a->upage < b->upage;
+}
+
+/* Frees the page that E refers to, along with its frame or swap
+   slot. */
+static void page_destroy(struct hash_elem* e, void* aux UNUSED) {
+  struct page* p = hash_entry(e, struct page, elem);
+
+  /* Wait for any eviction of the page to finish. */
+  lock_acquire(&p->lock);
+  if (p->frame != NULL) {
+    pagedir_clear_page(p->owner->pagedir, p->upage);
+    frame_free(p->frame);
+  } else if (p->swap_slot != SWAP_ERROR)
+    swap_free(p->swap_slot);
+  lock_release(&p->lock);
+
+  slab_free(&page_cache, p);
+}
@@ -0,0 +1,71 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+/* Supplemental page table.
+
+   Each process has a table of the pages in its address space,
+   recording for each one where its contents come from, so that
+   a page need not be in memory until the process first touches
+   it.  When the process is loaded, its executable's segments are
+   entered in the table instead of being read, and the page fault
+   handler reads or zeroes each page on first access.
+
+   Unlike the hardware page table, the supplemental page table
+   keeps its entries after the pages are loaded, since it is the
+   only record of which parts of the address space are valid.
+
+   A loaded page may be evicted to make room for another (see
+   vm/frame.h).  A page that is unchanged since it was loaded is
+   simply dropped, to be loaded again from its source, but one
+   that has been modified is written to swap and becomes a
+   PAGE_SWAP page for good.
+
+   The stack starts out as a single page, and grows a page at a
+   time when the process touches memory just below it (see
+   page_in()), up to page_stack_max pages.
+
+   Each page has a lock, held while it is loaded, evicted, or
+   freed, so that these cannot overlap. */
+
+/* Where a page's contents come from when it is loaded. */
+enum page_type {
+  PAGE_ZERO, /* All zeros. */
+  PAGE_FILE, /* Part of a file, followed by zeros. */
+  PAGE_SWAP  /* A swap slot. */
+};
+
+/* A page in a process's address space. */
+struct page {
+  void* upage;           /* User virtual address. */
+  struct thread* owner;  /* Process whose address space has the page. */
+  enum page_type type;   /* Source of contents. */
+  bool writable;         /* Writable by the process? */
+  struct file* file;     /* PAGE_FILE: File to read. */
+  off_t ofs;             /* PAGE_FILE: Offset in FILE. */
+  size_t read_bytes;     /* PAGE_FILE: Bytes to read; the rest are zeroed. */
+  size_t swap_slot;      /* PAGE_SWAP: Slot, or SWAP_ERROR while loaded. */
+  struct lock lock;      /* Serializes loading, eviction, and freeing. */
+  struct frame* frame;   /* Frame holding the page, or null if not loaded. */
+  struct hash_elem elem; /* Element in the process's page table. */
+};
+
+/* Maximum size of a user stack, in pages. */
+extern size_t page_stack_max;
+
+bool page_table_create(void);
+void page_table_destroy(void);
+
+bool page_add_file(void* upage, struct file*, off_t ofs, size_t read_bytes, bool writable);
+bool page_add_zero(void* upage, bool writable);
+bool page_in(const void* uaddr, bool write);
+bool page_pin(const void* uaddr, bool write);
+void page_unpin(const void* uaddr);
+bool page_out(struct page*);
+
+#endif /* vm/page.h */
@@ -0,0 +1,111 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors in a swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block* swap_device; /* Swap device, or null if none. */
+static struct bitmap* used_slots; /* Slots holding pages. */
+static size_t used_cnt;           /* Number of slots in use. */
+static struct lock swap_lock;     /* Protects the members above and below. */
+
+/* Statistics. */
+static size_t max_used; /* Most slots in use at once. */
+static uint64_t outs;   /* Pages written. */
+static uint64_t ins;    /* Pages read. */
+
+static void transfer_slot(size_t slot, void* kpage, bool write);
+
+/* Sets up swap space on the swap block device, if there is
+   one. */
+void swap_init(void) {
+  size_t slot_cnt = 0;
+
+  swap_device = block_get_role(BLOCK_SWAP);
+  if (swap_device != NULL)
+    slot_cnt = block_size(swap_device) / SECTORS_PER_SLOT;
+  used_slots = bitmap_create(slot_cnt);
+  if (used_slots == NULL)
+    PANIC("swap bitmap creation failed");
+  lock_init(&swap_lock);
+}
+
+/* Writes the page at KPAGE to a free swap slot and returns the
+   slot, or returns SWAP_ERROR if no slot is free. */
+size_t swap_out(const void* kpage) {
+  size_t slot;
+
+  lock_acquire(&swap_lock);
+  slot = bitmap_scan_and_flip(used_slots, 0, 1, false);
+  if (slot != BITMAP_ERROR) {
+    outs++;
+    if (++used_cnt > max_used)
+      max_used = used_cnt;
+  }
+  lock_release(&swap_lock);
+  if (slot == BITMAP_ERROR)
+    return SWAP_ERROR;
+
+  transfer_slot(slot, (void*)kpage, true);
+  return slot;
+}
+
+/* Reads the page in SLOT into KPAGE and frees SLOT. */
+void swap_in(size_t slot, void* kpage) {
+  transfer_slot(slot, kpage, false);
+
+  lock_acquire(&swap_lock);
+  ins++;
+  lock_release(&swap_lock);
+  swap_free(slot);
+}
+
+/* Frees SLOT without reading it. */
+void swap_free(size_t slot) {
+  lock_acquire(&swap_lock);
+  ASSERT(bitmap_test(used_slots, slot));
+  bitmap_reset(used_slots, slot);
+  used_cnt--;
+  lock_release(&swap_lock);
+}
+
+/* Completion function for transfer_slot()'s requests. */
+static void transfer_done(struct block_request* r) { sema_up(r->aux); }
+
+/* Writes the page at KPAGE to SLOT if WRITE is true, otherwise
+   reads SLOT into KPAGE.  All of the slot's sectors are queued at
+   once, so that the device can merge them into one transfer. */
+static void transfer_slot(size_t slot, void* kpage, bool write) {
+  struct block_request requests[SECTORS_PER_SLOT];
+  struct semaphore done;
+  uint64_t start = timer_tsc();
+  size_t i;
+
+  sema_init(&done, 0);
+  for (i = 0; i < SECTORS_PER_SLOT; i++) {
+    struct block_request* r = &requests[i];
+    r->sector = slot * SECTORS_PER_SLOT + i;
+    r->buffer = (uint8_t*)kpage + i * BLOCK_SECTOR_SIZE;
+    r->write = write;
+    r->done = transfer_done;
+    r->aux = &done;
+    block_submit(swap_device, r);
+  }
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    sema_down(&done);
+  thread_current()->usage.io_wait_us += timer_tsc_to_us(timer_tsc() - start);
+}
+
+/* Prints swap statistics. */
+void swap_print_stats(void) {
+  if (swap_device != NULL)
+    printf("Swap: %zu slots, %zu used at most, %llu pages out, %llu in\n",
+           bitmap_size(used_slots), max_used, outs, ins);
+}
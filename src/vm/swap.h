@@ -0,0 +1,25 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Swap space.
+
+   The swap block device is divided into page-size slots.  A
+   page evicted from memory whose contents cannot be recovered
+   from anywhere else is written to a free slot, and read back
+   when the process touches it again.  Without a swap device,
+   there are no slots, and only pages that can be reloaded from
+   their files, or are still all zeros, can be evicted. */
+
+/* Returned by swap_out() when no slot is free. */
+#define SWAP_ERROR SIZE_MAX
+
+void swap_init(void);
+size_t swap_out(const void* kpage);
+void swap_in(size_t slot, void* kpage);
+void swap_free(size_t slot);
+void swap_print_stats(void);
+
+#endif /* vm/swap.h */